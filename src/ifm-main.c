@@ -19,6 +19,7 @@
 #include <ctype.h>
 #include <string.h>
 #include <math.h>
+#include <sys/time.h>
 #include <vars.h>
 
 #include "ifm-driver.h"
@@ -51,14 +52,17 @@ static int nowarn = 0;          /* Whether to suppress warnings */
 static int max_errors = 10;     /* Print this many errors before abort */
 
 static vlist *sections = NULL;  /* List of map sections to output */
+static vhash *stats = NULL;     /* Solver statistics */
 
 /* Internal functions */
 static void message(char *type, char *msg);
 static void print_version(void);
+static void run_phase(char *name, void (*func)(void));
 static int select_format(char *str);
 static void show_info(char *type);
 static void show_maps(void);
 static void show_path(void);
+static void show_stats(void);
 static void usage(void);
 
 /* Info options */
@@ -69,9 +73,44 @@ static struct show_st {
     { "maps", "Show map sections",      show_maps },
     { "vars", "Show defined variables", var_list  },
     { "path", "Show file search path",  show_path },
+    { "solver-stats", "Show solver statistics", show_stats },
     { NULL,   NULL,                NULL }
 };
 
+/* Solver statistics */
+static struct stat_st {
+    char *name, *desc, *fmt;
+} statopts[] = {
+    { "time_resolve_tags",   "Resolving tags (secs)",        "%.6f" },
+    { "time_setup_rooms",    "Setting up rooms (secs)",      "%.6f" },
+    { "time_setup_links",    "Setting up links (secs)",      "%.6f" },
+    { "time_connect_rooms",  "Connecting rooms (secs)",      "%.6f" },
+    { "time_setup_tasks",    "Setting up tasks (secs)",      "%.6f" },
+    { "time_check_cycles",   "Checking for cycles (secs)",   "%.6f" },
+    { "time_solve_game",     "Solving game (secs)",          "%.6f" },
+    { "find_path_calls",     "Non-trivial path requests",    "%.0f" },
+    { "find_path_cached",    "  answered from cache",        "%.0f" },
+    { "find_path_searches",  "  needing a search",           "%.0f" },
+    { "path_cache_hits",     "Path cache hits",              "%.0f" },
+    { "path_cache_misses",   "Path cache misses",            "%.0f" },
+    { "node_expansions",     "Rooms expanded by searches",   "%.0f" },
+    { "link_relaxations",    "Links queued by searches",     "%.0f" },
+    { "use_link_calls",      "Link usability checks",        "%.0f" },
+    { "use_node_calls",      "Room usability checks",        "%.0f" },
+    { "init_path_calls",     "Path initialisations",         "%.0f" },
+    { "path_cache_builds",   "  path cache rebuilds",        "%.0f" },
+    { "path_cache_repairs",  "  path cache repairs",         "%.0f" },
+    { "path_cache_flushes",  "  other-room cache flushes",   "%.0f" },
+    { "filter_tasks_calls",  "Task filtering runs",          "%.0f" },
+    { "filter_tasks_passes", "  passes over task list",      "%.0f" },
+    { "safety_checks",       "Task safety checks",           "%.0f" },
+    { "safety_reused",       "  verdicts reused",            "%.0f" },
+    { "order_edges",         "Task orderings",               "%.0f" },
+    { "order_duplicates",    "  repeats skipped",            "%.0f" },
+    { "new_task_calls",      "Task steps created",           "%.0f" },
+    { NULL,                  NULL,                           NULL }
+};
+
 /* Main routine */
 int
 main(int argc, char *argv[])
@@ -262,15 +301,15 @@ main(int argc, char *argv[])
     }
 
     /* Resolve tags */
-    resolve_tags();
+    run_phase("resolve_tags", resolve_tags);
     if (ifm_errors)
         return 1;
 
     /* Set up rooms */
-    setup_rooms();
+    run_phase("setup_rooms", setup_rooms);
 
     /* Set up links */
-    setup_links();
+    run_phase("setup_links", setup_links);
     if (ifm_errors)
         return 1;
 
@@ -281,20 +320,20 @@ main(int argc, char *argv[])
     setup_sections();
 
     /* Connect rooms together */
-    connect_rooms();
+    run_phase("connect_rooms", connect_rooms);
     if (ifm_errors)
         return 1;
 
     /* Set up tasks */
-    setup_tasks();
+    run_phase("setup_tasks", setup_tasks);
     if (ifm_errors)
         return 1;
 
     /* Solve game if required */
     if (!OUTPUT || write_tasks) {
-        check_cycles();
+        run_phase("check_cycles", check_cycles);
         if (!ifm_errors)
-            solve_game();
+            run_phase("solve_game", solve_game);
         else
             return 1;
     }
@@ -531,6 +570,26 @@ print_version(void)
     exit(0);
 }
 
+/* Run a setup phase, recording its wall time */
+static void
+run_phase(char *name, void (*func)(void))
+{
+    struct timeval start, end;
+    V_BUF_DECL;
+
+    gettimeofday(&start, NULL);
+    func();
+    gettimeofday(&end, NULL);
+
+    if (stats == NULL)
+        stats = vh_create();
+
+    V_BUF_SET1("time_%s", name);
+    vh_dstore(stats, V_BUF_VAL,
+              (end.tv_sec - start.tv_sec) +
+              (end.tv_usec - start.tv_usec) / 1.0e6);
+}
+
 /* Show some information */
 static void
 show_info(char *type)
@@ -596,6 +655,30 @@ show_path(void)
     printf("%s\n", vl_join(ifm_search, " "));
 }
 
+/* Print solver statistics */
+static void
+show_stats(void)
+{
+    int i, raw = (ifm_format != NULL && V_STREQ(ifm_format, "raw"));
+
+    if (stats == NULL)
+        stats = vh_create();
+
+    path_counts(stats);
+    task_counts(stats);
+
+    /* Raw format gives 'name: value' lines, like raw output */
+    for (i = 0; statopts[i].name != NULL; i++) {
+        if (raw)
+            printf("%s: ", statopts[i].name);
+        else
+            printf("%-32s ", statopts[i].desc);
+
+        printf(statopts[i].fmt, vh_dget(stats, statopts[i].name));
+        printf("\n");
+    }
+}
+
 /* Print a usage message and exit */
 static void
 usage()
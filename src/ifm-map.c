@@ -49,12 +49,21 @@ vhash *startroom = NULL;        /* Starting room */
 vlist *taskorder = NULL;        /* Ordered task list */
 vlist *sectnames = NULL;	/* List of section names */
 
+/* Room position table entry */
+struct rpos {
+    int sect, x, y;             /* Section and coordinates */
+    vhash *room;                /* Room there (or NULL if unused) */
+};
+
 /* Internal stuff */
-static vhash *rpos = NULL;      /* Room positions */
+static struct rpos *rpos = NULL; /* Room position hash table */
+static int rpos_size = 0;       /* No. of table entries */
+static int rpos_count = 0;      /* No. of entries in use */
 
 /* Internal functions */
 static void put_room_at(vhash *room, int sect, int x, int y);
 static vhash *room_at(int sect, int x, int y);
+static struct rpos *rpos_entry(int sect, int x, int y);
 static void resolve_tag(char *type, vscalar *elt, vhash *table);
 static void resolve_tag_list(char *type, vlist *list, vhash *table);
 
@@ -70,8 +79,6 @@ init_map(void)
     tasks = vl_create();
     sects = vl_create();
 
-    rpos = vh_create();
-
     roomtags = vh_create();
     itemtags = vh_create();
     linktags = vh_create();
@@ -87,8 +94,6 @@ init_map(void)
     vh_pstore(map, "TASKS", taskorder);
     vh_pstore(map, "SECTS", sects);
 
-    vh_pstore(map, "RPOS", rpos);
-
     vh_pstore(map, "ROOMTAGS", roomtags);
     vh_pstore(map, "ITEMTAGS", itemtags);
     vh_pstore(map, "TASKTAGS", tasktags);
@@ -98,10 +103,33 @@ init_map(void)
 static void
 put_room_at(vhash * room, int sect, int x, int y)
 {
-    V_BUF_DECL;
+    struct rpos *old, *entry;
+    int i, size;
+
+    /* Grow the table if it's getting full */
+    if (2 * (rpos_count + 1) > rpos_size) {
+        old = rpos;
+        size = rpos_size;
+
+        rpos_size = V_MAX(2 * size, 256);
+        rpos = V_CALLOC(struct rpos, rpos_size);
+
+        for (i = 0; i < size; i++)
+            if (old[i].room != NULL)
+                *rpos_entry(old[i].sect, old[i].x, old[i].y) = old[i];
+
+        V_DEALLOC(old);
+    }
+
+    entry = rpos_entry(sect, x, y);
+    if (entry->room == NULL)
+        rpos_count++;
+
+    entry->sect = sect;
+    entry->x = x;
+    entry->y = y;
+    entry->room = room;
 
-    V_BUF_SET3("%d,%d,%d", sect, x, y);
-    vh_pstore(rpos, V_BUF_VAL, room);
     vh_istore(room, "X", x);
     vh_istore(room, "Y", y);
 }
@@ -235,10 +263,29 @@ resolve_tags(void)
 static vhash *
 room_at(int sect, int x, int y)
 {
-    V_BUF_DECL;
+    if (rpos == NULL)
+        return NULL;
 
-    V_BUF_SET3("%d,%d,%d", sect, x, y);
-    return vh_pget(rpos, V_BUF_VAL);
+    return rpos_entry(sect, x, y)->room;
+}
+
+/* Return the position table entry for a location, or a free one */
+static struct rpos *
+rpos_entry(int sect, int x, int y)
+{
+    unsigned int pos;
+    struct rpos *entry;
+
+    pos = ((unsigned int) sect * 73856093u) ^
+        ((unsigned int) x * 19349663u) ^ ((unsigned int) y * 83492791u);
+
+    while (1) {
+        entry = &rpos[pos & (rpos_size - 1)];
+        if (entry->room == NULL ||
+            (entry->sect == sect && entry->x == x && entry->y == y))
+            return entry;
+        pos++;
+    }
 }
 
 /* Set/unset a room exit */
@@ -492,58 +539,124 @@ setup_links(void)
 void
 setup_rooms(void)
 {
-    vhash *base, *room, *link, *near, *other, *sect;
-    int nfound, x, y, dir, num;
-    vlist *list, *dirs;
+    int x, y, dir, num, id, nid, npass, n, *pass, *pos, *count;
+    vhash *base, *room, *link, *near, *other, *sect, **order;
+    vlist *list, *dirs, *chain;
     viter i, j, k;
 
+    /*
+     * Rooms are placed in the order that repeatedly sweeping through a
+     * section's room list would place them: in the same sweep as the
+     * room they're relative to if they come after it in the list, and
+     * in the next sweep otherwise.  Working out each room's sweep
+     * first means they can all be placed in a single pass.
+     */
+    n = V_MAX(vl_length(rooms), 1);
+    pass = V_ALLOC(int, n);
+    pos = V_ALLOC(int, n);
+    count = V_ALLOC(int, n + 1);
+    order = V_ALLOC(vhash *, n);
+    chain = vl_create();
+
     v_iterate(sects, i) {
         sect = vl_iter_pval(i);
 
         num = vh_iget(sect, "NUM");
         list = vh_pget(sect, "ROOMS");
 
+        n = 0;
+        v_iterate(list, j) {
+            id = vh_iget(vl_iter_pval(j), "ID");
+            pos[id] = n++;
+            pass[id] = -1;
+        }
+
 	/* Position base room */
 	base = vl_ptail(list);
+        pass[vh_iget(base, "ID")] = 0;
 	put_room_at(base, num, 0, 0);
 
-	/* Position all other rooms relative to it */
-        do {
-	    nfound = 0;
+        /* Find the sweep in which each other room gets placed */
+        npass = 1;
+        v_iterate(list, j) {
+            room = vl_iter_pval(j);
+
+            while (pass[id = vh_iget(room, "ID")] == -1) {
+                pass[id] = -2;
+                vl_ppush(chain, room);
 
-	    v_iterate(list, j) {
-		room = vl_iter_pval(j);
+                if ((link = vh_pget(room, "LINK")) == NULL)
+                    break;
 
-                if (vh_exists(room, "X"))
-		    continue;
+                room = vh_pget(link, "FROM");
+            }
 
-		if ((link = vh_pget(room, "LINK")) == NULL)
+            while (vl_length(chain) > 0) {
+                room = vl_ppop(chain);
+                link = vh_pget(room, "LINK");
+                if (link == NULL)
                     continue;
 
-                near = vh_pget(link, "FROM");
-                if (!vh_exists(near, "X"))
-		    continue;
-
-		x = vh_iget(near, "X");
-		y = vh_iget(near, "Y");
-
-		dirs = vh_pget(link, "DIR");
-		v_iterate(dirs, k) {
-		    dir = vl_iter_ival(k);
-		    x += dirinfo[dir].xoff;
-		    y += dirinfo[dir].yoff;
-		}
-
-		if ((other = room_at(num, x, y)) != NULL)
-		    warn("rooms '%s' and '%s' overlap",
-                         vh_sgetref(room, "DESC"),
-                         vh_sgetref(other, "DESC"));
-
-		put_room_at(room, num, x, y);
-		nfound++;
-	    }
-	} while (nfound > 0);
+                id = vh_iget(room, "ID");
+                nid = vh_iget(vh_pget(link, "FROM"), "ID");
+                if (pass[nid] < 0)
+                    continue;
+
+                pass[id] = pass[nid] + (pos[id] < pos[nid]);
+                npass = V_MAX(npass, pass[id] + 1);
+            }
+        }
+
+        /* Sort the rooms by sweep, keeping list order within each */
+        for (n = 0; n <= npass; n++)
+            count[n] = 0;
+
+        v_iterate(list, j) {
+            id = vh_iget(vl_iter_pval(j), "ID");
+            if (pass[id] > 0)
+                count[pass[id] + 1]++;
+        }
+
+        for (n = 1; n <= npass; n++)
+            count[n] += count[n - 1];
+
+        v_iterate(list, j) {
+            room = vl_iter_pval(j);
+            id = vh_iget(room, "ID");
+            if (pass[id] > 0)
+                order[count[pass[id]]++] = room;
+        }
+
+	/* Position all other rooms relative to it */
+        for (n = 0; n < count[npass - 1]; n++) {
+            room = order[n];
+            link = vh_pget(room, "LINK");
+            near = vh_pget(link, "FROM");
+
+            x = vh_iget(near, "X");
+            y = vh_iget(near, "Y");
+
+            dirs = vh_pget(link, "DIR");
+            v_iterate(dirs, k) {
+                dir = vl_iter_ival(k);
+                x += dirinfo[dir].xoff;
+                y += dirinfo[dir].yoff;
+            }
+
+            if ((other = room_at(num, x, y)) != NULL)
+                warn("rooms '%s' and '%s' overlap",
+                     vh_sgetref(room, "DESC"),
+                     vh_sgetref(other, "DESC"));
+
+            put_room_at(room, num, x, y);
+        }
     }
+
+    vl_destroy(chain);
+    V_DEALLOC(pass);
+    V_DEALLOC(pos);
+    V_DEALLOC(count);
+    V_DEALLOC(order);
 }
 
 /* Set up sections */
@@ -24,14 +24,21 @@
 #include "ifm-task.h"
 #include "ifm-util.h"
 
-#define NODE(room)           vh_sgetref(room, "NODE")
+#define NODE(room)           vh_iget(room, "NODENUM")
 
-#define PATH_NODES(r1, r2)   vg_path_nodes(graph, NODE(r1), NODE(r2))
-#define PATH_INFO(r1, r2)    vg_path_info(graph, NODE(r1), NODE(r2))
-#define PATH_LENGTH(r1, r2)  ((int) vg_path_length(graph, NODE(r1), NODE(r2)))
+#define PATH_NODES(r1, r2)   vg_ipath_nodes(graph, NODE(r1), NODE(r2))
+#define PATH_INFO(r1, r2)    vg_ipath_info(graph, NODE(r1), NODE(r2))
+#define PATH_LENGTH(r1, r2)  ((int) vg_ipath_length(graph, NODE(r1), NODE(r2)))
+#define PATH_CACHED(r1, r2)  ((r1) == path_room || (r2) == path_room)
 
 #define BIG 1000
 
+/* No. of other rooms to cache paths from */
+#define CACHE_ROOMS 64
+
+/* No. of landmark rooms for directing uncached path searches */
+#define LANDMARKS 8
+
 /* Graph structure */
 static vgraph *graph = NULL;
 
@@ -44,17 +51,104 @@ static vhash *path_room = NULL;
 /* Path task */
 static vhash *path_task = NULL;
 
+/* Path generation (changes when unblocked paths might have changed) */
+static int path_gen = 0;
+
+/* Path task when path cache was built */
+static vhash *cache_task = NULL;
+
+/* Whether to keep quiet about unusable links and rooms */
+static int path_quiet = 0;
+
+/* Whether path searches use the path cache */
+static int path_cached = 0;
+
+/* Compiled usability conditions of a reach-element or room */
+struct cond {
+    vhash *obj;                 /* Reach-element or room */
+    int link;                   /* Whether it's a reach-element */
+    int index;                  /* Graph link or node index */
+    int open;                   /* Whether usable when cache last updated */
+    int free;                   /* Whether usable when paths last checked */
+    unsigned long *need;        /* Items needed */
+    unsigned long *leave;       /* Items which might have to be left */
+    unsigned long *before;      /* Tasks which mustn't be done yet */
+    unsigned long *after;       /* Tasks which must be done */
+};
+
+/* Reach-element conditions, and link index -> first of them */
+static struct cond *link_conds = NULL;
+static int *link_first = NULL;
+
+/* Room conditions, by node index */
+static struct cond *room_conds = NULL;
+
+/* Conditions whose usability can change */
+static struct cond **watch_conds = NULL;
+static int watch_count = 0;
+
+/* No. of item and task bits */
+static int item_bits = 0;
+static int task_bits = 0;
+
+/* Items blocked by the path task, and the task they were found for */
+static unsigned long *block_items = NULL;
+static vhash *block_task = NULL;
+
+/* Last blocked-path search of each step: its rooms, path generation,
+ * items blocked and result */
+static vhash **memo_from = NULL;
+static vhash **memo_to = NULL;
+static int *memo_gen = NULL;
+static unsigned long *memo_items = NULL;
+static int *memo_len = NULL;
+static int memo_alloc = 0;
+
+/* Task list steps in ID order, and their IDs */
+static vhash **id_steps = NULL;
+static int *id_nums = NULL;
+static int id_count = 0;
+static int id_alloc = 0;
+
+/* Task list position of the first step with each sort code */
+static int *sort_first = NULL;
+static int sort_alloc = 0;
+
+/* Solver statistics */
+static long find_calls = 0;     /* No. of non-trivial find_path() calls */
+static long find_cached = 0;    /* No. answered from the path cache */
+static long find_searches = 0;  /* No. needing a fresh search */
+static long link_checks = 0;    /* No. of use_link() calls */
+static long node_checks = 0;    /* No. of use_node() calls */
+static long init_calls = 0;     /* No. of init_path() calls */
+static long cache_builds = 0;   /* No. of path cache rebuilds */
+static long cache_repairs = 0;  /* No. of path cache repairs */
+static long cache_flushes = 0;  /* No. of other-room cache flushes */
+
 #ifdef SHOW_VISIT
 /* Find-path start room */
 static vhash *start_room = NULL;
 #endif
 
 /* Internal functions */
+static int block_search(vhash *step, vhash *from, vhash *to);
+static unsigned long *block_set(void);
+static int blocked(unsigned long *leave);
+static int check_paths(void);
+static int check_reachable(vhash *from, vhash *to);
+static unsigned long *cond_bits(vhash *obj, char *attr, int task);
+static unsigned long cond_checksum(unsigned long sum, struct cond *c);
+static void cond_compile(struct cond *c, vhash *obj, int link, int index);
+static int cond_usable(struct cond *c, int report);
 static void link_rooms(vhash *from, vhash *to, vhash *reach);
 static double link_size(char *fnode, char *tnode, vscalar *s);
+static vlist *reach_path(vlist *list);
+static void sort_steps(void);
 static int sort_tasks(vscalar **v1, vscalar **v2);
-static int use_link(char *fnode, char *tnode, vscalar *s);
-static int use_node(char *node, vscalar *s, double dist);
+static int usable(vhash *obj, int link, int report);
+static int use_link(int link);
+static int use_node(int node, double dist);
+static int watch_paths(int report);
 
 /* Connect rooms as a directed graph */
 void
@@ -276,24 +370,313 @@ connect_rooms(void)
     }
 
     /* Set graph functions */
-    vg_use_node_function(graph, use_node);
-    vg_use_link_function(graph, use_link);
+    vg_use_inode_function(graph, use_node);
+    vg_use_ilink_function(graph, use_link);
 
     if (uselen)
         vg_link_size_function(graph, link_size);
+
+    vg_cache_size(graph, CACHE_ROOMS);
+    vg_use_landmarks(graph, LANDMARKS);
+
+    /* Freeze graph and record room node indices */
+    vg_compile(graph);
+
+    v_iterate(rooms, iter) {
+        room = vl_iter_pval(iter);
+        vh_istore(room, "NODENUM",
+                  vg_node_index(graph, vh_sgetref(room, "NODE")));
+    }
+}
+
+/* Find a blocked path for the path task, unless found already */
+static int
+block_search(vhash *step, vhash *from, vhash *to)
+{
+    int i, len, id = STEP_ID(step), num = BITS_LEN(item_bits);
+    unsigned long *bits = block_set(), *memo;
+    vlist *path;
+
+    if (id >= memo_alloc) {
+        i = memo_alloc;
+        memo_alloc = V_MAX(2 * memo_alloc, id + 256);
+        memo_from = V_REALLOC(memo_from, vhash *, memo_alloc);
+        memo_to = V_REALLOC(memo_to, vhash *, memo_alloc);
+        memo_gen = V_REALLOC(memo_gen, int, memo_alloc);
+        memo_len = V_REALLOC(memo_len, int, memo_alloc);
+        memo_items = V_REALLOC(memo_items, unsigned long,
+                               memo_alloc * num + 1);
+        while (i < memo_alloc)
+            memo_from[i++] = NULL;
+    }
+
+    /*
+     * The result only depends on the rooms, the items blocked, and which
+     * links and rooms are usable, so if none of those have changed, the
+     * last search (and its path, if not used yet) still stands.
+     */
+    memo = memo_items + id * num;
+
+    if (memo_from[id] == from && memo_to[id] == to &&
+        memo_gen[id] == path_gen &&
+        memcmp(memo, bits, num * sizeof(unsigned long)) == 0 &&
+        (memo_len[id] == NOPATH || vh_exists(step, "PATH"))) {
+        find_cached++;
+
+        if (TASK_VERBOSE) {
+            if (memo_len[id] == NOPATH)
+                printf(" (cached: no path)\n");
+            else
+                printf(" (cached: dist %d)\n", memo_len[id]);
+        }
+
+        return memo_len[id];
+    }
+
+    if (TASK_VERBOSE)
+        printf("\n");
+
+    find_searches++;
+
+    if ((path = vh_pget(step, "PATH")) != NULL)
+        vl_destroy(path);
+    vh_delete(step, "PATH");
+
+    if (!check_reachable(from, to) ||
+        (path = PATH_INFO(from, to)) == NULL) {
+        len = NOPATH;
+    } else {
+        len = vl_ishift(path);
+        vh_pstore(step, "PATH", path);
+    }
+
+    memo_from[id] = from;
+    memo_to[id] = to;
+    memo_gen[id] = path_gen;
+    memo_len[id] = len;
+    memcpy(memo, bits, num * sizeof(unsigned long));
+
+    return len;
+}
+
+/* Return the items blocked by the path task */
+static unsigned long *
+block_set(void)
+{
+    vhash *item;
+    viter iter;
+
+    if (block_task != path_task) {
+        memset(block_items, 0, BITS_LEN(item_bits) * sizeof(unsigned long));
+
+        v_iterate(items, iter) {
+            item = vl_iter_pval(iter);
+            if (vh_pget(item, "BLOCK") == path_task)
+                BIT_SET(block_items, vh_iget(item, "BIT"));
+        }
+
+        block_task = path_task;
+    }
+
+    return block_items;
+}
+
+/* Return whether any of a set of items are blocked by the path task */
+static int
+blocked(unsigned long *leave)
+{
+    return bits_common(leave, block_set(), item_bits);
+}
+
+/* Return whether links or rooms have changed for non-blocked paths */
+static int
+check_paths(void)
+{
+    int i, flag, changed = 0;
+    vhash *task;
+    struct cond *c;
+
+    task = path_task;
+    path_task = NULL;
+
+    for (i = 0; i < watch_count; i++) {
+        c = watch_conds[i];
+        if ((flag = cond_usable(c, 0)) != c->free) {
+            c->free = flag;
+            changed = 1;
+        }
+    }
+
+    path_task = task;
+    return changed;
+}
+
+/* Return whether there might be a path between two rooms */
+static int
+check_reachable(vhash *from, vhash *to)
+{
+    vhash *task = path_task;
+    int flag;
+
+    /*
+     * Blocked paths only use links and rooms that unblocked ones can, so
+     * if there's no unblocked path there's no path at all.
+     */
+    path_task = NULL;
+    path_quiet = 1;
+    flag = vg_ipath_reachable(graph, NODE(from), NODE(to));
+    path_quiet = 0;
+    path_task = task;
+
+    return flag;
+}
+
+/* Compile link and room conditions into bit sets */
+void
+compile_paths(void)
+{
+    int i, num, count = 0;
+    vhash *room;
+    vlist *list;
+    viter iter;
+
+    item_bits = vl_length(items);
+    task_bits = vl_length(tasks);
+    block_items = bits_create(item_bits);
+    block_task = NULL;
+
+    /* Compile reach-element conditions of each link */
+    num = vg_link_count(graph);
+    for (i = 0; i < num; i++)
+        count += vl_length(vg_link_pvalue(graph, i));
+
+    link_first = V_ALLOC(int, num + 1);
+    link_conds = V_ALLOC(struct cond, V_MAX(count, 1));
+    watch_conds = V_ALLOC(struct cond *, count + vl_length(rooms) + 1);
+    watch_count = count = 0;
+
+    for (i = 0; i < num; i++) {
+        link_first[i] = count;
+        list = vg_link_pvalue(graph, i);
+        v_iterate(list, iter) {
+            vh_istore(vl_iter_pval(iter), "INDEX", count);
+            cond_compile(&link_conds[count++], vl_iter_pval(iter), 1, i);
+        }
+    }
+
+    link_first[num] = count;
+
+    /* Compile room conditions */
+    room_conds = V_ALLOC(struct cond, vg_node_count(graph) + 1);
+
+    v_iterate(rooms, iter) {
+        room = vl_iter_pval(iter);
+        cond_compile(&room_conds[NODE(room)], room, 0, NODE(room));
+    }
+}
+
+/* Return bit set of the items or tasks in an attribute list */
+static unsigned long *
+cond_bits(vhash *obj, char *attr, int task)
+{
+    unsigned long *bits;
+    vhash *thing;
+    vlist *list;
+    viter iter;
+
+    if ((list = vh_pget(obj, attr)) == NULL)
+        return NULL;
+
+    bits = bits_create(task ? task_bits : item_bits);
+
+    v_iterate(list, iter) {
+        thing = vl_iter_pval(iter);
+        if (task)
+            thing = vh_pget(thing, "STEP");
+        BIT_SET(bits, vh_iget(thing, "BIT"));
+    }
+
+    return bits;
+}
+
+/* Add the conditions of a reach-element or room to a checksum */
+static unsigned long
+cond_checksum(unsigned long sum, struct cond *c)
+{
+    unsigned long *bits[4];
+    int i, j, len;
+
+    sum = 31 * sum + c->index;
+    sum = 31 * sum + vh_iget(c->obj, "LEN");
+
+    bits[0] = c->need;
+    bits[1] = c->leave;
+    bits[2] = c->before;
+    bits[3] = c->after;
+
+    for (i = 0; i < 4; i++) {
+        sum = 31 * sum + (bits[i] != NULL);
+        if (bits[i] == NULL)
+            continue;
+
+        len = BITS_LEN(i < 2 ? item_bits : task_bits);
+        for (j = 0; j < len; j++)
+            sum = 31 * sum + bits[i][j];
+    }
+
+    return sum;
+}
+
+/* Compile the conditions of a reach-element or room */
+static void
+cond_compile(struct cond *c, vhash *obj, int link, int index)
+{
+    c->obj = obj;
+    c->link = link;
+    c->index = index;
+    c->open = c->free = 0;
+
+    c->need = cond_bits(obj, "NEED", 0);
+    c->leave = cond_bits(obj, "LEAVE", 0);
+    c->before = cond_bits(obj, "BEFORE", 1);
+    c->after = cond_bits(obj, "AFTER", 1);
+
+    /* Watch it if its usability can change */
+    if (c->need != NULL || c->leave != NULL ||
+        c->before != NULL || c->after != NULL)
+        watch_conds[watch_count++] = c;
+}
+
+/* Return whether a compiled reach-element or room is usable */
+static int
+cond_usable(struct cond *c, int report)
+{
+    if ((c->leave != NULL && path_task != NULL && blocked(c->leave)) ||
+        (c->need != NULL && !bits_subset(c->need, taken_items, item_bits)) ||
+        (c->before != NULL && bits_common(c->before, done_tasks, task_bits)) ||
+        (c->after != NULL && !bits_subset(c->after, done_tasks, task_bits))) {
+        /* Find out why, for the record */
+        if (report && TASK_VERBOSE && !path_quiet)
+            usable(c->obj, c->link, 1);
+
+        return 0;
+    }
+
+    return 1;
 }
 
 /* Return length of a path between two rooms */
 int
 find_path(vhash *step, vhash *from, vhash *to)
 {
-    vlist *path;
     int len;
 
     /* Check trivial case */
     if (from == to)
         return 0;
 
+    find_calls++;
+
 #ifdef SHOW_VISIT
     start_room = from;
 #endif
@@ -305,31 +688,28 @@ find_path(vhash *step, vhash *from, vhash *to)
                vh_sgetref(to, "DESC"));
     }
 
-    if (step != NULL && vh_iget(step, "BLOCK")) {
-        if (TASK_VERBOSE)
-            printf("\n");
-
+    if (step != NULL && STEP_TEST(STEP_ID(step), S_BLOCK)) {
         path_task = step;
-        if ((path = vh_pget(step, "PATH")) != NULL)
-            vl_destroy(path);
-        vh_delete(step, "PATH");
-
-        vg_use_cache(graph, 0);
-        if ((path = PATH_INFO(from, to)) == NULL)
-            return NOPATH;
-
-        len = vl_ishift(path);
-        vh_pstore(step, "PATH", path);
+        vg_use_cache(graph, path_cached = 0);
+        len = block_search(step, from, to);
     } else {
         path_task = NULL;
-        vg_use_cache(graph, 1);
+        vg_use_cache(graph, path_cached = 1);
+
+        if (PATH_CACHED(from, to))
+            find_cached++;
+        else
+            find_searches++;
 
-        if (TASK_VERBOSE && path_room != from)
+        if (TASK_VERBOSE && !PATH_CACHED(from, to))
             printf("\n");
 
+        if (!PATH_CACHED(from, to) && !check_reachable(from, to))
+            return NOPATH;
+
         len = PATH_LENGTH(from, to);
 
-        if (TASK_VERBOSE && path_room == from) {
+        if (TASK_VERBOSE && PATH_CACHED(from, to)) {
             if (len < 0)
                 printf(" (cached: no path)\n");
             else
@@ -344,49 +724,44 @@ find_path(vhash *step, vhash *from, vhash *to)
 vlist *
 get_path(vhash *step, vhash *room)
 {
-    static vlist *path = NULL;
-    vlist *list, *rlist;
-    char *node, *next;
-    int i, len, found;
-    vhash *reach;
-    viter iter;
+    vhash *task;
+    vlist *list, *path;
 
     /* Build path */
     list = vh_pget(step, "PATH");
     vh_delete(step, "PATH");
 
-    if (list == NULL)
+    /* Check links with the same path task the path was found with */
+    task = path_task;
+    if (list == NULL) {
+        path_task = cache_task;
         list = PATH_NODES(path_room, room);
+    } else {
+        path_task = step;
+    }
 
-    if (list == NULL)
-        return NULL;
+    path = reach_path(list);
+    path_task = task;
+    return path;
+}
 
-    if (path == NULL)
-        path = vl_create();
-    else
-        vl_empty(path);
+/* Return an unblocked path between any two rooms, or NULL if none */
+vlist *
+get_route(vhash *from, vhash *to)
+{
+    vhash *task = path_task;
+    vlist *path;
 
-    /* Record reach-elements that were used */
-    len = vl_length(list);
-    node = vl_sgetref(list, 0);
+    path_task = NULL;
+    path_quiet = 1;
 
-    for (i = 1; i < len; i++) {
-        next = vl_sgetref(list, i);
-        rlist = vg_link_pget(graph, node, next);
-        found = 0;
-
-        v_iterate(rlist, iter) {
-            reach = vl_iter_pval(iter);
-            if (!found && vh_iget(reach, "USE")) {
-                vl_ppush(path, reach);
-                found++;
-            }
-        }
+    vg_use_cache(graph, 1);
+    path = reach_path(PATH_NODES(from, to));
+    vg_use_cache(graph, path_cached);
 
-        node = next;
-    }
+    path_quiet = 0;
+    path_task = task;
 
-    vl_destroy(list);
     return path;
 }
 
@@ -394,29 +769,49 @@ get_path(vhash *step, vhash *room)
 void
 init_path(vhash *room)
 {
-    vhash *step, *item, *taskroom;
-    int len, blockable, offset;
+    vhash *step, *item, *taskroom, *task;
+    int len, blockable, offset, repair, id;
     vlist *list;
     double dist;
     viter i, j;
 
+    /* Forget paths from other rooms if links or rooms have changed */
+    init_calls++;
+    if ((len = check_paths()) != 0) {
+        vg_cache_flush(graph);
+        cache_flushes++;
+        path_gen++;
+    }
+
+    /* Cache unblocked paths back to this room, for return-path checks */
+    if (len || room != path_room) {
+        task = path_task;
+        path_task = NULL;
+        solver_msg(2, "updating return path cache");
+        dist = vg_ipath_rcache(graph, NODE(room));
+        solver_msg(2, "updated return path cache (max dist %g)", dist);
+        path_task = task;
+    }
+
     /* Only need update if room changed, or path modified */
     if (room == path_room && !path_modify)
         return;
 
+    repair = (room == path_room);
     path_room = room;
     path_modify = 0;
 
     /* Deal with tasks that need droppable items */
     v_iterate(tasklist, i) {
         step = vl_iter_pval(i);
-        if (vh_iget(step, "DONE"))
+        id = STEP_ID(step);
+        if (STEP_TEST(id, S_DONE))
             continue;
 
         if ((list = vh_pget(step, "NEED")) == NULL)
             continue;
 
-        if ((taskroom = vh_pget(step, "ROOM")) == NULL)
+        if ((taskroom = step_room[id]) == NULL)
             continue;
 
         blockable = 0;
@@ -430,12 +825,13 @@ init_path(vhash *room)
                 continue;
 
             vh_pstore(item, "BLOCK", step);
+            block_task = NULL;
             blockable = 1;
         }
 
         if (blockable) {
             /* Find path to task room */
-            vh_istore(step, "BLOCK", 1);
+            STEP_SET(id, S_BLOCK);
 
             if (TASK_VERBOSE) {
                 indent(2);
@@ -446,47 +842,60 @@ init_path(vhash *room)
             }
 
             if ((len = find_path(step, room, taskroom)) != NOPATH)
-                vh_istore(step, "SORT", len);
+                step_sort[id] = len;
             else
-                vh_istore(step, "SORT", BIG);
+                step_sort[id] = BIG;
         }
     }
 
-    /* Cache paths from this room */
-    solver_msg(2, "updating path cache");
-    dist = vg_path_cache(graph, NODE(room));
-    solver_msg(2, "updated path cache (max dist %g)", dist);
+    /* Cache paths from this room, or repair the existing cache */
+    if (repair && path_task == cache_task) {
+        solver_msg(2, "repairing path cache");
+        len = watch_paths(1);
+        dist = vg_ipath_repair(graph);
+        cache_repairs++;
+        solver_msg(2, "repaired path cache (%d changes, max dist %g)",
+                   len, dist);
+    } else {
+        solver_msg(2, "updating path cache");
+        cache_task = path_task;
+        dist = vg_ipath_cache(graph, NODE(room));
+        watch_paths(0);
+        cache_builds++;
+        solver_msg(2, "updated path cache (max dist %g)", dist);
+    }
 
     /* Record distance of each task */
     v_iterate(tasklist, i) {
-        step = vl_iter_pval(i);
+        id = STEP_ID(vl_iter_pval(i));
 
-        if (vh_iget(step, "BLOCK"))
-            len = vh_iget(step, "SORT");
-        else if ((taskroom = vh_pget(step, "ROOM")) == NULL)
+        if (STEP_TEST(id, S_BLOCK))
+            len = step_sort[id];
+        else if ((taskroom = step_room[id]) == NULL)
             len = 0;
         else if ((len = PATH_LENGTH(room, taskroom)) < 0)
             len = BIG;
 
         /* Put 'get-item' tasks a bit further */
-        offset = (vh_iget(step, "TYPE") == T_GET);
-        vh_istore(step, "SORT", 2 * len + offset);
-        vh_istore(step, "DIST", len);
+        offset = (step_type[id] == T_GET);
+        step_sort[id] = 2 * len + offset;
+        step_dist[id] = len;
     }
 
-    /* Sort tasks according to distance */
-    vl_sort(tasklist, sort_tasks);
+    /* Sort tasks according to distance, and record their order */
+    sort_steps();
 
     if (TASK_VERBOSE) {
         vhash *room;
 
         v_iterate(tasklist, i) {
             step = vl_iter_pval(i);
+            id = STEP_ID(step);
 
-            if (vh_iget(step, "DONE") || vh_iget(step, "IGNORED"))
+            if (STEP_TEST(id, S_DONE | S_IGNORED))
                 continue;
 
-            if ((len = vh_iget(step, "DIST")) == BIG)
+            if ((len = step_dist[id]) == BIG)
                 continue;
 
             if (require_task(step) != NULL)
@@ -494,7 +903,7 @@ init_path(vhash *room)
 
             indent(3);
             printf("dist %d: %s", len, vh_sgetref(step, "DESC"));
-            if (len > 0 && (room = vh_pget(step, "ROOM")) != NULL)
+            if (len > 0 && (room = step_room[id]) != NULL)
                 printf(" (%s)", vh_sgetref(room, "DESC"));
             printf("\n");
         }
@@ -547,200 +956,287 @@ void
 modify_path(int print)
 {
     path_modify = 1;
+    path_gen++;
 
     if (print)
         solver_msg(2, "flag path cache update");
 }
 
+/* Return a checksum of the map's links and their conditions */
+unsigned long
+path_checksum(void)
+{
+    unsigned long sum;
+    int k, num;
+    viter iter;
+
+    num = vg_link_count(graph);
+    sum = num;
+
+    for (k = 0; k < link_first[num]; k++)
+        sum = cond_checksum(sum, &link_conds[k]);
+
+    v_iterate(rooms, iter)
+        sum = cond_checksum(sum, &room_conds[NODE(vl_iter_pval(iter))]);
+
+    return sum;
+}
+
+/* Return the current path generation */
+int
+path_generation(void)
+{
+    return path_gen;
+}
+
+/* Return a reach-element given its index, if it's usable from a room */
+vhash *
+path_reach(int index, vhash *from)
+{
+    vhash *reach, *task;
+    int usable;
+
+    if (index < 0 || index >= link_first[vg_link_count(graph)])
+        return NULL;
+
+    reach = link_conds[index].obj;
+    if (vh_pget(reach, "FROM") != from)
+        return NULL;
+
+    task = path_task;
+    path_task = NULL;
+    usable = (cond_usable(&link_conds[index], 0) &&
+              cond_usable(&room_conds[NODE(vh_pget(reach, "TO"))], 0));
+    path_task = task;
+
+    return (usable ? reach : NULL);
+}
+
+/* Record path search statistics */
+void
+path_counts(vhash *stats)
+{
+    long nodes = 0, links = 0;
+    int hits = 0, misses = 0;
+
+    if (graph != NULL) {
+        vg_cache_info(graph, &hits, &misses);
+        vg_visit_info(graph, &nodes, &links);
+    }
+
+    vh_dstore(stats, "find_path_calls", find_calls);
+    vh_dstore(stats, "find_path_cached", find_cached);
+    vh_dstore(stats, "find_path_searches", find_searches);
+    vh_dstore(stats, "path_cache_hits", hits);
+    vh_dstore(stats, "path_cache_misses", misses);
+    vh_dstore(stats, "node_expansions", nodes);
+    vh_dstore(stats, "link_relaxations", links);
+    vh_dstore(stats, "use_link_calls", link_checks);
+    vh_dstore(stats, "use_node_calls", node_checks);
+    vh_dstore(stats, "init_path_calls", init_calls);
+    vh_dstore(stats, "path_cache_builds", cache_builds);
+    vh_dstore(stats, "path_cache_repairs", cache_repairs);
+    vh_dstore(stats, "path_cache_flushes", cache_flushes);
+}
+
+/* Print path cache statistics */
+void
+path_stats(void)
+{
+    int hits, misses;
+
+    vg_cache_info(graph, &hits, &misses);
+    solver_msg(1, "path cache: %d hits, %d misses", hits, misses);
+}
+
+/* Return the reach-elements used by a path, given its node indices */
+static vlist *
+reach_path(vlist *list)
+{
+    static vlist *path = NULL;
+    int i, k, len, node, next, num;
+
+    if (list == NULL)
+        return NULL;
+
+    if (path == NULL)
+        path = vl_create();
+    else
+        vl_empty(path);
+
+    /* Record first usable reach-element of each link */
+    len = vl_length(list);
+    node = vl_iget(list, 0);
+
+    for (i = 1; i < len; i++) {
+        next = vl_iget(list, i);
+        num = vg_link_index(graph, node, next);
+
+        for (k = link_first[num]; k < link_first[num + 1]; k++) {
+            if (cond_usable(&link_conds[k], 0)) {
+                vl_ppush(path, link_conds[k].obj);
+                break;
+            }
+        }
+
+        node = next;
+    }
+
+    vl_destroy(list);
+    return path;
+}
+
 /* Return list of reachable rooms from a given room */
 vlist *
 reachable_rooms(vhash *room)
 {
     static vlist *list = NULL;
-    vlist *rlist, *tlist;
-    char *node, *next;
-    viter i, j;
+    int i, num, *out;
+    vlist *rlist;
+    viter iter;
 
     if (list == NULL)
         list = vl_create();
     else
         vl_empty(list);
 
-    node = NODE(room);
-    tlist = vg_node_to(graph, node);
+    num = vg_node_out(graph, NODE(room), &out);
 
-    v_iterate(tlist, i) {
-        next = vl_iter_svalref(i);
-        rlist = vg_link_pget(graph, node, next);
-        v_iterate(rlist, j)
-            vl_ppush(list, vl_iter_pval(j));
+    for (i = 0; i < num; i++) {
+        rlist = vg_link_pvalue(graph, out[i]);
+        v_iterate(rlist, iter)
+            vl_ppush(list, vl_iter_pval(iter));
     }
 
-    vl_destroy(tlist);
     return list;
 }
 
-/* Task sorting function */
-int
-sort_tasks(vscalar **v1, vscalar **v2)
+/* Sort the task list by sort code and then ID, and record the order */
+static void
+sort_steps(void)
 {
-    vhash *t1 = vs_pget(*v1);
-    vhash *t2 = vs_pget(*v2);
-    int s1 = vh_iget(t1, "SORT");
-    int s2 = vh_iget(t2, "SORT");
+    int i, j, id, key, pos, num, minkey, maxkey;
+    vhash *step;
+    viter iter;
 
-    /* Try sort codes first */
-    if (s1 < s2)
-        return -1;
-    else if (s1 > s2)
-        return 1;
+    /*
+     * Steps only get appended to the task list, so any past the end of
+     * the ID-ordered list are new.  Add them to it.
+     */
+    num = vl_length(tasklist);
 
-    /* Try order of declaration */
-    s1 = vh_iget(t1, "ID");
-    s2 = vh_iget(t2, "ID");
+    if (num > id_alloc) {
+        id_alloc = 2 * num;
+        id_steps = V_REALLOC(id_steps, vhash *, id_alloc);
+        id_nums = V_REALLOC(id_nums, int, id_alloc);
+    }
 
-    if (s1 < s2)
-        return -1;
-    else if (s1 > s2)
-        return 1;
+    for (i = id_count; i < num; i++) {
+        step = vl_pget(tasklist, i);
+        id = STEP_ID(step);
 
-    /* Shouldn't get here */
-    return 0;
-}
+        for (j = i; j > 0 && id_nums[j - 1] > id; j--) {
+            id_steps[j] = id_steps[j - 1];
+            id_nums[j] = id_nums[j - 1];
+        }
 
-/* Is link usable? */
-static int
-use_link(char *fnode, char *tnode, vscalar *s)
-{
-    vhash *reach, *item, *task, *tstep, *block, *room;
-    vlist *list, *rlist;
-    viter i, j;
-    int flag;
+        id_steps[j] = step;
+        id_nums[j] = id;
+    }
 
-    /* Loop over all reach elements of this link */
-    rlist = vs_pget(s);
-    v_iterate(rlist, i) {
-        reach = vl_iter_pval(i);
-        vh_istore(reach, "USE", 0);
-        flag = 1;
-
-        /* Check items needed by task don't have to be left */
-        if (path_task != NULL && (list = vh_pget(reach, "LEAVE")) != NULL) {
-            v_iterate(list, j) {
-                item = vl_iter_pval(j);
-                block = vh_pget(item, "BLOCK");
-                if (block != NULL && block == path_task) {
-                    if (TASK_VERBOSE) {
-                        indent(4 - vg_caching());
-                        room = vg_node_pget(graph, tnode);
-                        printf("blocked link: %s (must leave %s)\n",
-                               vh_sgetref(room, "DESC"),
-                               vh_sgetref(item, "DESC"));
-                    }
-
-                    flag = 0;
-                    break;
-                }
-            }
+    id_count = num;
+    minkey = maxkey = (num > 0 ? step_sort[id_nums[0]] : 0);
 
-            if (!flag)
-                continue;
-        }
+    for (i = 1; i < num; i++) {
+        key = step_sort[id_nums[i]];
+        minkey = V_MIN(minkey, key);
+        maxkey = V_MAX(maxkey, key);
+    }
 
-        /* Check required items have been obtained */
-        if ((list = vh_pget(reach, "NEED")) != NULL) {
-            v_iterate(list, j) {
-                item = vl_iter_pval(j);
-                if (!vh_iget(item, "TAKEN")) {
-                    if (TASK_VERBOSE) {
-                        indent(4 - vg_caching());
-                        room = vg_node_pget(graph, tnode);
-                        printf("blocked link: %s (need %s)\n",
-                               vh_sgetref(room, "DESC"),
-                               vh_sgetref(item, "DESC"));
-                    }
-
-                    flag = 0;
-                    break;
-                }
-            }
+    /*
+     * Sort codes are small unless links are very long, so normally the
+     * steps can be put straight into buckets, in ID order.  If not (or
+     * a code has overflowed), fall back to sorting them.
+     */
+    if (minkey < 0 || (maxkey > 2 * BIG + 1 && maxkey > 4 * num)) {
+        vl_sort(tasklist, sort_tasks);
 
-            if (!flag)
-                continue;
-        }
+        pos = 0;
+        v_iterate(tasklist, iter)
+            step_order[STEP_ID(vl_iter_pval(iter))] = pos++;
 
-        /* Check status of required tasks */
-        if ((list = vh_pget(reach, "BEFORE")) != NULL) {
-            v_iterate(list, j) {
-                task = vl_iter_pval(j);
-                tstep = vh_pget(task, "STEP");
-                if (vh_iget(tstep, "DONE")) {
-                    if (TASK_VERBOSE) {
-                        indent(4 - vg_caching());
-                        room = vg_node_pget(graph, tnode);
-                        printf("blocked link: %s (done '%s')\n",
-                               vh_sgetref(room, "DESC"),
-                               vh_sgetref(task, "DESC"));
-                    }
-
-                    flag = 0;
-                    break;
-                }
-            }
+        return;
+    }
 
-            if (!flag)
-                continue;
-        }
+    if (maxkey >= sort_alloc) {
+        sort_alloc = maxkey + 1;
+        sort_first = V_REALLOC(sort_first, int, sort_alloc);
+    }
 
-        if ((list = vh_pget(reach, "AFTER")) != NULL) {
-            v_iterate(list, j) {
-                task = vl_iter_pval(j);
-                tstep = vh_pget(task, "STEP");
-                if (!vh_iget(tstep, "DONE")) {
-                    if (TASK_VERBOSE) {
-                        indent(4 - vg_caching());
-                        room = vg_node_pget(graph, tnode);
-                        printf("blocked link: %s (not done '%s')\n",
-                               vh_sgetref(room, "DESC"),
-                               vh_sgetref(task, "DESC"));
-                    }
-
-                    flag = 0;
-                    break;
-                }
-            }
+    for (key = 0; key <= maxkey; key++)
+        sort_first[key] = 0;
 
-            if (!flag)
-                continue;
-        }
+    for (i = 0; i < num; i++)
+        sort_first[step_sort[id_nums[i]]]++;
 
-        /* Flag it as usable */
-        vh_istore(reach, "USE", 1);
-        return 1;
+    for (key = pos = 0; key <= maxkey; key++) {
+        j = sort_first[key];
+        sort_first[key] = pos;
+        pos += j;
     }
 
+    for (i = 0; i < num; i++) {
+        id = id_nums[i];
+        pos = sort_first[step_sort[id]]++;
+        vs_pstore(vl_get(tasklist, pos), id_steps[i]);
+        step_order[id] = pos;
+    }
+}
+
+/* Task sorting function */
+int
+sort_tasks(vscalar **v1, vscalar **v2)
+{
+    int id1 = STEP_ID(vs_pget(*v1));
+    int id2 = STEP_ID(vs_pget(*v2));
+    int s1 = step_sort[id1];
+    int s2 = step_sort[id2];
+
+    /* Try sort codes first */
+    if (s1 < s2)
+        return -1;
+    else if (s1 > s2)
+        return 1;
+
+    /* Try order of declaration */
+    if (id1 < id2)
+        return -1;
+    else if (id1 > id2)
+        return 1;
+
+    /* Shouldn't get here */
     return 0;
 }
 
-/* Is room visitable? */
+/* Return whether a reach-element or room is usable */
 static int
-use_node(char *node, vscalar *s, double dist)
+usable(vhash *obj, int link, int report)
 {
-    vhash *room, *item, *task, *tstep, *block;
+    vhash *item, *task, *tstep, *block, *room;
+    char *type = (link ? "link" : "room");
     vlist *list;
     viter iter;
 
-    room = vs_pget(s);
-
     /* Check items needed by task don't have to be left */
-    if (path_task != NULL && (list = vh_pget(room, "LEAVE")) != NULL) {
+    if (path_task != NULL && (list = vh_pget(obj, "LEAVE")) != NULL) {
         v_iterate(list, iter) {
             item = vl_iter_pval(iter);
             block = vh_pget(item, "BLOCK");
             if (block != NULL && block == path_task) {
-                if (TASK_VERBOSE) {
+                if (report && TASK_VERBOSE) {
+                    room = (link ? vh_pget(obj, "TO") : obj);
                     indent(4 - vg_caching());
-                    printf("blocked room: %s (must leave %s)\n",
+                    printf("blocked %s: %s (must leave %s)\n", type,
                            vh_sgetref(room, "DESC"),
                            vh_sgetref(item, "DESC"));
                 }
@@ -750,14 +1246,15 @@ use_node(char *node, vscalar *s, double dist)
         }
     }
 
-    /* Check for required items */
-    if ((list = vh_pget(room, "NEED")) != NULL) {
+    /* Check required items have been obtained */
+    if ((list = vh_pget(obj, "NEED")) != NULL) {
         v_iterate(list, iter) {
             item = vl_iter_pval(iter);
             if (!vh_iget(item, "TAKEN")) {
-                if (TASK_VERBOSE) {
+                if (report && TASK_VERBOSE) {
+                    room = (link ? vh_pget(obj, "TO") : obj);
                     indent(4 - vg_caching());
-                    printf("blocked room: %s (need %s)\n",
+                    printf("blocked %s: %s (need %s)\n", type,
                            vh_sgetref(room, "DESC"),
                            vh_sgetref(item, "DESC"));
                 }
@@ -768,14 +1265,15 @@ use_node(char *node, vscalar *s, double dist)
     }
 
     /* Check status of required tasks */
-    if ((list = vh_pget(room, "BEFORE")) != NULL) {
+    if ((list = vh_pget(obj, "BEFORE")) != NULL) {
         v_iterate(list, iter) {
             task = vl_iter_pval(iter);
             tstep = vh_pget(task, "STEP");
-            if (vh_iget(tstep, "DONE")) {
-                if (TASK_VERBOSE) {
+            if (STEP_TEST(STEP_ID(tstep), S_DONE)) {
+                if (report && TASK_VERBOSE) {
+                    room = (link ? vh_pget(obj, "TO") : obj);
                     indent(4 - vg_caching());
-                    printf("blocked room: %s (done '%s')\n",
+                    printf("blocked %s: %s (done '%s')\n", type,
                            vh_sgetref(room, "DESC"),
                            vh_sgetref(task, "DESC"));
                 }
@@ -785,14 +1283,15 @@ use_node(char *node, vscalar *s, double dist)
         }
     }
 
-    if ((list = vh_pget(room, "AFTER")) != NULL) {
+    if ((list = vh_pget(obj, "AFTER")) != NULL) {
         v_iterate(list, iter) {
             task = vl_iter_pval(iter);
             tstep = vh_pget(task, "STEP");
-            if (!vh_iget(tstep, "DONE")) {
-                if (TASK_VERBOSE) {
+            if (!STEP_TEST(STEP_ID(tstep), S_DONE)) {
+                if (report && TASK_VERBOSE) {
+                    room = (link ? vh_pget(obj, "TO") : obj);
                     indent(4 - vg_caching());
-                    printf("blocked room: %s (not done '%s')\n",
+                    printf("blocked %s: %s (not done '%s')\n", type,
                            vh_sgetref(room, "DESC"),
                            vh_sgetref(task, "DESC"));
                 }
@@ -802,13 +1301,76 @@ use_node(char *node, vscalar *s, double dist)
         }
     }
 
+    return 1;
+}
+
+/* Is link usable? */
+static int
+use_link(int link)
+{
+    int k;
+
+    /* Loop over all reach elements of this link */
+    link_checks++;
+    for (k = link_first[link]; k < link_first[link + 1]; k++)
+        if (cond_usable(&link_conds[k], 1))
+            return 1;
+
+    return 0;
+}
+
+/* Is room visitable? */
+static int
+use_node(int node, double dist)
+{
+    node_checks++;
+    if (!cond_usable(&room_conds[node], 1))
+        return 0;
+
 #ifdef SHOW_VISIT
-    if (TASK_VERBOSE && room != start_room) {
+    if (TASK_VERBOSE && room_conds[node].obj != start_room) {
         indent(4 - vg_caching());
         printf("visit: %s (dist %g)\n",
-               vh_sgetref(room, "DESC"), dist);
+               vh_sgetref(room_conds[node].obj, "DESC"), dist);
     }
 #endif
 
     return 1;
 }
+
+/* Record usability of links and rooms, and maybe report changes */
+static int
+watch_paths(int report)
+{
+    int i, flag, count = 0;
+    vhash *obj;
+    struct cond *c;
+
+    for (i = 0; i < watch_count; i++) {
+        c = watch_conds[i];
+        flag = cond_usable(c, 0);
+
+        if (report && flag != c->open) {
+            obj = c->obj;
+
+            if (c->link) {
+                vg_link_changed(graph, c->index);
+                solver_msg(3, "%s link: %s to %s",
+                           flag ? "opened" : "closed",
+                           vh_sgetref(vh_pget(obj, "FROM"), "DESC"),
+                           vh_sgetref(vh_pget(obj, "TO"), "DESC"));
+            } else {
+                vg_node_changed(graph, c->index);
+                solver_msg(3, "%s room: %s",
+                           flag ? "opened" : "closed",
+                           vh_sgetref(obj, "DESC"));
+            }
+
+            count++;
+        }
+
+        c->open = flag;
+    }
+
+    return count;
+}
@@ -15,11 +15,18 @@
 #define NOPATH -1
 
 /* Advertised functions */
+extern void compile_paths(void);
 extern void connect_rooms(void);
 extern int find_path(vhash *step, vhash *from, vhash *to);
 extern vlist *get_path(vhash *step, vhash *room);
+extern vlist *get_route(vhash *from, vhash *to);
 extern void init_path(vhash *room);
 extern void modify_path(int print);
+extern unsigned long path_checksum(void);
+extern void path_counts(vhash *stats);
+extern int path_generation(void);
+extern vhash *path_reach(int index, vhash *from);
+extern void path_stats(void);
 extern vlist *reachable_rooms(vhash *room);
 
 #endif
@@ -18,6 +18,17 @@
 #include <stdarg.h>
 #include <string.h>
 #include <vars.h>
+#include <vars-freeze.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define USE_FORK
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
 
 #include "ifm-main.h"
 #include "ifm-map.h"
@@ -34,20 +45,116 @@
         location_desc = "nowhere";                      \
 } while (0)
 
+/* Max. no. of safe tasks to choose between when searching */
+#define SEARCH_WIDTH 3
+
+/* Max. no. of tasks to reorder at once */
+#define WINDOW_SIZE 12
+
+/* Route cost of a missing path */
+#define NO_ROUTE 100000
+
 /* Task step attributes */
 static char *taskattr[] = {
     "TAG", "STYLE", "CMD", "DROPALL", "HIDDEN", "DO", "DROP", "DROPROOM",
     "DROPUNTIL", "GET", "GIVE", "GOTO", "LOSE", "NEED", NULL
 };
 
+/* Task step attributes which stop it being reordered */
+static char *fixattr[] = {
+    "NEXT", "PREV", "MODPATH", "DO", "GET", "GIVE", "GOTO", "LOSE", "DROP",
+    "FINISH", NULL
+};
+
+/* Task step attributes which say what a task is */
+static char *signattr[] = {
+    "ROOM", "GOTO", "DEPEND", "NEED", "GET", "GIVE", "LOSE", "DROP",
+    "DROPROOM", "DROPUNTIL", "DROPALL", "DO", "NEXT", "PREV", "SCORE",
+    "FINISH", "SAFE", "UNSAFE", "IGNORE", "MODPATH", NULL
+};
+
+/* Variables which change the greedy solver's choices */
+static char *solvervars[] = {
+    "all_tasks_safe", "keep_unused_items", NULL
+};
+
 /* Task step flags */
 enum {
     TS_INVALID, TS_IGNORED, TS_UNSAFE, TS_SAFE
 };
 
+/* Task ordering types */
+enum {
+    O_ALLOW, O_DEPEND
+};
+
+/* Task step table, and its allocated size */
+int *step_type = NULL;
+int *step_flags = NULL;
+int *step_sort = NULL;
+int *step_dist = NULL;
+int *step_order = NULL;
+int *step_wait = NULL;
+vhash **step_room = NULL;
+static int step_alloc = 0;
+
+/* Step ID hash table entry */
+struct stepid {
+    vhash *step;                /* Task step */
+    int id;                     /* Its ID */
+};
+
+/* Step ID hash table, keyed by step address */
+static struct stepid *step_ids = NULL;
+static int step_ids_size = 0;
+
+/* Safety verdict of each step, and the room and path generation it was
+ * found for */
+static char **safe_msg = NULL;
+static vhash **safe_room = NULL;
+static int *safe_gen = NULL;
+
 /* Task step list */
 vlist *tasklist = NULL;
 
+/* Task steps not waiting for other steps (plus some that are done) */
+static vlist *readylist = NULL;
+
+/* Task orderings recorded from a step, as sorted codes */
+struct orderset {
+    int *codes;                 /* Codes (2 * later step ID + type) */
+    int count;                  /* No. of codes */
+    int alloc;                  /* Allocated size */
+};
+
+/* Task orderings recorded so far, indexed by step ID */
+static struct orderset *step_orders = NULL;
+
+/* Items, indexed by bit */
+static vhash **item_vec = NULL;
+
+/* Task steps needing each item (indexed by item bit) */
+static int *need_start = NULL;  /* Item bit -> start of its steps */
+static vhash **need_steps = NULL;
+
+/* Task steps to check for redundancy, and the ones in the current pass */
+static vlist *filterlist = NULL;
+static vqueue *filterqueue = NULL;
+
+/* Task list position of the step being checked (or -1 if none) */
+static int filterpos = -1;
+
+/* Items to check for dropping, and the ones in the current pass */
+static vlist *droplist = NULL;
+static vqueue *dropqueue = NULL;
+
+/* Item list position of the item being checked (or -1 if none) */
+static int droppos = -1;
+
+/* Inventory and done-task bit sets */
+unsigned long *taken_items = NULL;
+unsigned long *done_tasks = NULL;
+
 /* Current location */
 static vhash *location = NULL;
 static char *location_desc = "nowhere";
@@ -55,33 +162,146 @@ static char *location_desc = "nowhere";
 /* Control variables */
 static int all_tasks_safe = 0;
 static int keep_unused_items = 0;
+static int search_mode = 0;
+static int reorder_tasks = 0;
+
+/* No. of movement steps so far */
+static int num_moves = 0;
+
+/* Which safe task to choose at each choice point when searching (the
+ * first one at all choice points past the end), and no. of choices made */
+static int *search_alts = NULL;
+static int search_len = 0;
+static int search_count = 0;
+
+/* Where a search worker reports its choices, and its move limit */
+static FILE *search_out = NULL;
+static int search_bound = 0;
+
+/* Tasks done since the last change of state, if reordering them: the
+ * task order positions they span, the room before them, and the rooms
+ * first visited on the way */
+static vlist *window = NULL;
+static int window_start = 0;
+static int window_end = 0;
+static vhash *window_room = NULL;
+static vlist *window_visits = NULL;
+
+/* Whether moving to a task that's joining the window */
+static int window_moving = 0;
+
+/* Solver statistics */
+static long task_steps = 0;     /* No. of task steps created */
+static long filter_calls = 0;   /* No. of filter_tasks() calls */
+static long filter_passes = 0;  /* No. of passes over queued steps */
+static long safe_checks = 0;    /* No. of task safety checks */
+static long safe_hits = 0;      /* No. of safety verdicts reused */
+static long order_edges = 0;    /* No. of task orderings recorded */
+static long order_dups = 0;     /* No. of repeated orderings skipped */
+
+/* Checkpoints of the previous solver run, the no. of its task choices
+ * which can be replayed, and the route to the one being replayed */
+static vhash *checkpoint_old = NULL;
+static int replay_limit = 0;
+static vlist *replay_route = NULL;
+
+/* Checkpoints of this run, the no. of task choices between them, the user
+ * tasks done since the last one, and the route to the latest choice */
+static vhash *checkpoint_new = NULL;
+static int checkpoint_steps = 0;
+static vlist *checkpoint_done = NULL;
+static vlist *checkpoint_route = NULL;
 
 /* Internal functions */
 static void add_task(vhash *task);
+static char *checkpoint_key(vhash *step);
+static void checkpoint_load(void);
+static vhash *checkpoint_next(vhash *next);
+static void checkpoint_record(vhash *step);
+static void checkpoint_save(void);
+static char *checkpoint_sign(vhash *step);
+static char *checkpoint_state(void);
 static int do_task(vhash *task, int print, int recurse);
+static void drop_check(vhash *item);
 static void drop_item(vhash *item, vhash *room, vlist *until, int print);
+static void filter_check(vhash *step);
 static void filter_tasks(int print);
+static void filter_watch(vhash *obj);
 static vhash *first_task(vhash *step);
 static void goto_room(vhash *task);
 static void invert_items(vhash *obj, char *attr);
 static void mark_finishing(char *action, char *otype, char *varname,
                            vhash *table);
+static vhash *new_move(vhash *reach);
 static vhash *new_task(int type, vhash *data);
+static int order_new(int type, vhash *before, vhash *after);
 static void order_tasks(vhash *before, vhash *after);
+static vlist *ready_tasks(vhash *next);
+static vhash *search_choose(vlist *list);
+static int search_cmp(vlist *alts1, vlist *alts2);
+static void search_exit(int status);
+static void search_follow(vlist *alts);
+static void search_game(void);
+#ifdef USE_FORK
+static void search_start(vhash *job, int bound);
+#endif
+static void set_done(vhash *step);
+static void set_ready(vhash *step);
+static void set_taken(vhash *item, int flag);
+static void setup_needs(void);
+static void setup_wants(void);
+static int solve_tasks(void);
+static int sort_ready(vscalar **v1, vscalar **v2);
+static struct stepid *stepid_entry(vhash *step);
 static int task_status(vhash *room, vhash *step);
+static int tasks_left(void);
 static int want_item(vhash *item);
 static void warn_failure(void);
+static void window_add(vhash *step);
+static int window_cost(int *order, int num, int *dist);
+static void window_flush(void);
+static int window_join(vhash *step, int safe);
+static void window_moves(int *order, int num);
+static int window_order(int *order, int num);
 
 /* Add a task to the task list (if not already there) */
 static void
 add_task(vhash *task)
 {
-    if (!vh_exists(task, "DEPEND")) {
+    int id = STEP_ID(task);
+    vlist *list;
+    viter iter;
+
+    if (!STEP_TEST(id, S_LISTED)) {
         if (tasklist == NULL)
             tasklist = vl_create();
 
+        STEP_SET(id, S_LISTED);
+        step_order[id] = vl_length(tasklist);
         vl_ppush(tasklist, task);
         vh_pstore(task, "DEPEND", vl_create());
+        set_ready(task);
+
+        /* Recheck redundancy when anything it refers to changes */
+        if ((list = vh_pget(task, "GET")) != NULL) {
+            v_iterate(list, iter)
+                add_list(vl_iter_pval(iter), "RECHECK", task);
+        }
+
+        if ((list = vh_pget(task, "GIVE")) != NULL) {
+            v_iterate(list, iter)
+                add_list(vl_iter_pval(iter), "RECHECK", task);
+        }
+
+        if ((list = vh_pget(task, "DO")) != NULL) {
+            v_iterate(list, iter)
+                add_list(vl_iter_pval(iter), "RECHECK", task);
+        }
+
+        if (step_type[id] == T_GET)
+            add_list(vh_pget(task, "DATA"), "RECHECK", task);
+
+        filter_check(task);
     }
 }
 
@@ -139,27 +359,395 @@ check_cycles(void)
         count, (count == 1 ? "y" : "ies"), V_BUF_VAL);
 }
 
+/* Return the key which identifies a task step between solver runs */
+static char *
+checkpoint_key(vhash *step)
+{
+    vhash *item;
+
+    if (vh_exists(step, "KEY"))
+        return vh_sgetref(step, "KEY");
+
+    /* Getting a dropped item counts as getting it the first time */
+    if (step_type[STEP_ID(step)] == T_GET) {
+        item = vh_pget(step, "DATA");
+        if ((step = vh_pget(item, "STEP")) != NULL && vh_exists(step, "KEY"))
+            return vh_sgetref(step, "KEY");
+    }
+
+    return "";
+}
+
+/* Set up solver checkpoints, and see how much of the last run to replay */
+static void
+checkpoint_load(void)
+{
+    char *file, *key;
+    vhash *obj, *step, *keys, *oldkeys, *chosen;
+    int i, num, count, id, changed;
+    vlist *list, *choices, *routes;
+    V_NBUF_DECL(keybuf);
+    V_BUF_DECL;
+    viter iter;
+    FILE *fp;
+
+    file = var_string("solver_checkpoint_file");
+    if (*file == '\0')
+        return;
+
+    checkpoint_steps = V_MAX(var_int("solver_checkpoint_steps"), 1);
+    checkpoint_done = vl_create();
+
+    V_BUF_SET1("%lx", path_checksum());
+
+    checkpoint_new = vh_create();
+    vh_sstore(checkpoint_new, "MAP", V_BUF_VAL);
+    vh_istore(checkpoint_new, "STEPS", checkpoint_steps);
+
+    V_BUF_INIT;
+    for (i = 0; solvervars[i] != NULL; i++)
+        V_BUF_ADD2(" %s=%d", solvervars[i], var_int(solvervars[i]));
+    vh_sstore(checkpoint_new, "VARS", V_BUF_VAL);
+
+    vh_pstore(checkpoint_new, "CHOICES", vl_create());
+    vh_pstore(checkpoint_new, "ROUTES", vl_create());
+    vh_pstore(checkpoint_new, "STATES", vl_create());
+
+    /* Give task steps keys, and record what each one does */
+    keys = vh_create();
+    vh_pstore(checkpoint_new, "TASKS", keys);
+
+    for (i = 0; i < 3; i++) {
+        list = (i == 0 ? tasks : i == 1 ? items : rooms);
+        if (list == NULL)
+            continue;
+
+        v_iterate(list, iter) {
+            obj = vl_iter_pval(iter);
+            if ((step = vh_pget(obj, "STEP")) == NULL)
+                continue;
+
+            id = STEP_ID(step);
+            if (step_type[id] == T_USER)
+                V_BUF_SET2("task %s in %s", vh_sgetref(step, "DESC"),
+                           (step_room[id] != NULL ?
+                            vh_sgetref(step_room[id], "DESC") : "any room"));
+            else
+                V_BUF_SET(vh_sgetref(step, "DESC"));
+
+            /* Tell apart steps which look the same */
+            key = V_BUF_VAL;
+            for (count = 2; vh_exists(keys, key); count++) {
+                V_NBUF_SET2(keybuf, "%s #%d", V_BUF_VAL, count);
+                key = V_NBUF_VAL(keybuf);
+            }
+
+            vh_sstore(step, "KEY", key);
+            vh_sstore(keys, key, checkpoint_sign(step));
+        }
+    }
+
+    /* Read the previous checkpoints, if any */
+    if ((fp = fopen(file, "r")) == NULL)
+        return;
+
+    checkpoint_old = v_thaw(fp);
+    fclose(fp);
+
+    if (checkpoint_old == NULL || !vh_check(checkpoint_old)) {
+        warn("can't read checkpoint file '%s': %s", file, v_thaw_error());
+        checkpoint_old = NULL;
+        return;
+    }
+
+    oldkeys = vh_pget(checkpoint_old, "TASKS");
+    choices = vh_pget(checkpoint_old, "CHOICES");
+    routes = vh_pget(checkpoint_old, "ROUTES");
+
+    if (!vh_check(oldkeys) || !vl_check(choices) || !vl_check(routes) ||
+        !vl_check(vh_pget(checkpoint_old, "STATES")) ||
+        vl_length(routes) != vl_length(choices)) {
+        warn("checkpoint file '%s' is invalid", file);
+        checkpoint_old = NULL;
+        return;
+    }
+
+    v_iterate(routes, iter) {
+        if (!vl_check(vl_iter_pval(iter))) {
+            warn("checkpoint file '%s' is invalid", file);
+            checkpoint_old = NULL;
+            return;
+        }
+    }
+
+    /* Nothing can be replayed if the map or solver settings have changed */
+    if (vh_iget(checkpoint_old, "STEPS") != checkpoint_steps ||
+        !V_STREQ(vh_sgetref(checkpoint_old, "MAP"),
+                 vh_sgetref(checkpoint_new, "MAP")) ||
+        !vh_exists(checkpoint_old, "VARS") ||
+        !V_STREQ(vh_sgetref(checkpoint_old, "VARS"),
+                 vh_sgetref(checkpoint_new, "VARS"))) {
+        solver_msg(1, "Not replaying task steps from %s", file);
+        return;
+    }
+
+    /*
+     * Nor if a task has been added, or removed or changed without having
+     * been chosen, since the solver might now choose it at any point.
+     */
+    chosen = vh_create();
+    v_iterate(choices, iter)
+        vh_istore(chosen, vl_iter_svalref(iter), 1);
+
+    changed = 0;
+    v_iterate(keys, iter) {
+        key = vh_iter_key(iter);
+        if (!vh_exists(chosen, key) &&
+            (!vh_exists(oldkeys, key) ||
+             !V_STREQ(vh_sgetref(keys, key), vh_sgetref(oldkeys, key))))
+            changed = 1;
+    }
+
+    v_iterate(oldkeys, iter) {
+        key = vh_iter_key(iter);
+        if (!vh_exists(chosen, key) && !vh_exists(keys, key))
+            changed = 1;
+    }
+
+    vh_destroy(chosen);
+
+    if (changed) {
+        solver_msg(1, "Not replaying task steps from %s (tasks changed)",
+                   file);
+        return;
+    }
+
+    /*
+     * Replay up to the last checkpoint before the first task choice
+     * whose task has changed, or the whole run if none have.
+     */
+    num = vl_length(choices);
+    for (i = 0; i < num; i++) {
+        key = vl_sgetref(choices, i);
+        if (!vh_exists(keys, key) || !vh_exists(oldkeys, key) ||
+            !V_STREQ(vh_sgetref(keys, key), vh_sgetref(oldkeys, key))) {
+            num = i - i % checkpoint_steps;
+            break;
+        }
+    }
+
+    solver_msg(1, "Replaying %d of %d task steps from %s",
+               num, vl_length(choices), file);
+
+    replay_limit = num;
+}
+
+/* Return the previous run's next task choice, if it can still be made */
+static vhash *
+checkpoint_next(vhash *next)
+{
+    vhash *step = NULL, *trystep, *reach, *room, *target;
+    vlist *choices, *states, *routes;
+    char *key, *state;
+    int count, num;
+    viter iter;
+
+    if (checkpoint_new == NULL)
+        return NULL;
+
+    choices = vh_pget(checkpoint_new, "CHOICES");
+    states = vh_pget(checkpoint_new, "STATES");
+    count = vl_length(choices);
+    num = count / checkpoint_steps;
+
+    /* Record state at each checkpoint, and check it's as it was before */
+    if (count > 0 && count % checkpoint_steps == 0 &&
+        vl_length(states) < num) {
+        state = checkpoint_state();
+        vl_spush(states, state);
+
+        if (replay_limit > 0) {
+            states = vh_pget(checkpoint_old, "STATES");
+            if (vl_length(states) < num ||
+                !V_STREQ(state, vl_sgetref(states, num - 1))) {
+                solver_msg(1, "Checkpoint %d differs", num);
+                replay_limit = count;
+            }
+        }
+    }
+
+    if (replay_limit == 0)
+        return NULL;
+
+    /* Find the task step it chose */
+    if (count < replay_limit) {
+        key = vl_sgetref(vh_pget(checkpoint_old, "CHOICES"), count);
+
+        v_iterate(ready_tasks(next), iter) {
+            trystep = vl_iter_pval(iter);
+            if (!STEP_TEST(STEP_ID(trystep), S_DONE) &&
+                V_STREQ(checkpoint_key(trystep), key)) {
+                step = trystep;
+                break;
+            }
+        }
+    }
+
+    /* Check it can still be done, and its route can still be taken */
+    if (step != NULL) {
+        if (require_task(step) != NULL || vh_iget(step, "IGNORE"))
+            step = NULL;
+    }
+
+    if (step != NULL) {
+        if ((target = vh_pget(step, "ROOM")) == NULL)
+            target = location;
+
+        routes = vh_pget(checkpoint_old, "ROUTES");
+        vl_init(replay_route);
+        room = location;
+
+        v_iterate((vlist *) vl_pget(routes, count), iter) {
+            if ((reach = path_reach(vl_iter_ival(iter), room)) == NULL)
+                break;
+            vl_ppush(replay_route, reach);
+            room = vh_pget(reach, "TO");
+        }
+
+        if (room != target)
+            step = NULL;
+    }
+
+    /* If not, go back to choosing tasks */
+    if (step == NULL) {
+        solver_msg(1, "Replayed %d task steps", count);
+        replay_limit = 0;
+    }
+
+    return step;
+}
+
+/* Record a task choice for the next solver run */
+static void
+checkpoint_record(vhash *step)
+{
+    if (checkpoint_new != NULL) {
+        vl_spush(vh_pget(checkpoint_new, "CHOICES"), checkpoint_key(step));
+        checkpoint_route = vl_create();
+        vl_ppush(vh_pget(checkpoint_new, "ROUTES"), checkpoint_route);
+    }
+}
+
+/* Write solver checkpoints for the next run */
+static void
+checkpoint_save(void)
+{
+    char *file;
+    int ok = 0;
+    FILE *fp;
+
+    if (checkpoint_new == NULL)
+        return;
+
+    file = var_string("solver_checkpoint_file");
+    if ((fp = fopen(file, "w")) != NULL) {
+        ok = v_freeze(checkpoint_new, fp);
+        if (fclose(fp) != 0)
+            ok = 0;
+    }
+
+    if (!ok)
+        warn("can't write checkpoint file '%s'", file);
+}
+
+/* Return a string saying what a task step does */
+static char *
+checkpoint_sign(vhash *step)
+{
+    vscalar *val;
+    vhash *obj;
+    V_BUF_DECL;
+    viter iter;
+    void *ptr;
+    int i;
+
+    V_BUF_INIT;
+
+    for (i = 0; signattr[i] != NULL; i++) {
+        if ((val = vh_get(step, signattr[i])) == NULL)
+            continue;
+
+        V_BUF_ADD1(" %s:", signattr[i]);
+
+        if (vs_type(val) != V_TYPE_POINTER) {
+            V_BUF_ADD(vs_sget(val));
+        } else if (vl_check(ptr = vs_pget(val))) {
+            v_iterate((vlist *) ptr, iter) {
+                obj = vl_iter_pval(iter);
+                V_BUF_ADD1(" [%s]", vh_sgetref(obj, "DESC"));
+            }
+        } else if (ptr != NULL) {
+            V_BUF_ADD(vh_sgetref(ptr, "DESC"));
+        }
+    }
+
+    return V_BUF_VAL;
+}
+
+/* Return a string saying where the solver is and what it's done */
+static char *
+checkpoint_state(void)
+{
+    vhash *item, *room, *step;
+    V_BUF_DECL;
+    viter iter;
+
+    V_BUF_SET(location_desc);
+
+    /* Items carried, or left somewhere else */
+    v_iterate(items, iter) {
+        item = vl_iter_pval(iter);
+        room = vh_pget(item, "ROOM");
+        step = vh_pget(item, "STEP");
+
+        if (vh_iget(item, "TAKEN"))
+            V_BUF_ADD1(" [%s]", vh_sgetref(item, "DESC"));
+        else if (room != NULL && step != NULL &&
+                 room != step_room[STEP_ID(step)])
+            V_BUF_ADD2(" [%s in %s]", vh_sgetref(item, "DESC"),
+                       vh_sgetref(room, "DESC"));
+    }
+
+    /* User tasks done since the last checkpoint */
+    v_iterate(checkpoint_done, iter)
+        V_BUF_ADD1(" {%s}", vl_iter_svalref(iter));
+
+    vl_empty(checkpoint_done);
+
+    return V_BUF_VAL;
+}
+
 /* Perform a task */
 static int
 do_task(vhash *task, int print, int recurse)
 {
-    int scoretask = 1, score, filter = 0;
+    int scoretask = 1, score, filter = 0, id = STEP_ID(task), sid;
     vhash *item, *room, *otask, *step;
     vlist *list, *until;
     viter iter;
 
-    if (vh_iget(task, "DONE"))
+    if (STEP_TEST(id, S_DONE))
         return 1;
 
     /* Do the task */
-    switch (vh_iget(task, "TYPE")) {
+    switch (step_type[id]) {
 
     case T_GET:
         item = vh_pget(task, "DATA");
         if (vh_exists(item, "TAKEN"))
             scoretask = 0;
 
-        vh_istore(item, "TAKEN", 1);
+        set_taken(item, 1);
         if (vh_iget(item, "GIVEN"))
             print = 0;
 
@@ -172,7 +760,7 @@ do_task(vhash *task, int print, int recurse)
 
     case T_DROP:
         item = vh_pget(task, "DATA");
-        vh_istore(item, "TAKEN", 0);
+        set_taken(item, 0);
         solver_msg(3, "drop item: %s", vh_sgetref(item, "DESC"));
         if (vh_iget(item, "LOST"))
             print = 0;
@@ -213,7 +801,7 @@ do_task(vhash *task, int print, int recurse)
     }
 
     /* Flag it as done */
-    vh_istore(task, "DONE", 1);
+    set_done(task);
 
     /* Get any given items */
     if ((list = vh_pget(task, "GIVE")) != NULL) {
@@ -226,7 +814,7 @@ do_task(vhash *task, int print, int recurse)
             }
 
             solver_msg(3, "give item: %s", vh_sgetref(item, "DESC"));
-            vh_istore(item, "TAKEN", 1);
+            set_taken(item, 1);
         }
     }
 
@@ -235,7 +823,7 @@ do_task(vhash *task, int print, int recurse)
         v_iterate(list, iter) {
             item = vl_iter_pval(iter);
             solver_msg(3, "lose item: %s", vh_sgetref(item, "DESC"));
-            vh_istore(item, "TAKEN", 0);
+            set_taken(item, 0);
         }
     }
 
@@ -257,7 +845,8 @@ do_task(vhash *task, int print, int recurse)
         v_iterate(list, iter) {
             otask = vl_iter_pval(iter);
             step = vh_pget(otask, "STEP");
-            if (vh_iget(step, "DONE"))
+            sid = STEP_ID(step);
+            if (STEP_TEST(sid, S_DONE))
                 continue;
 
             if (vh_iget(step, "MODPATH")) {
@@ -269,6 +858,7 @@ do_task(vhash *task, int print, int recurse)
 
             add_attr(step, "CMD", NULL);
             vh_pstore(step, "ROOM", location);
+            step_room[sid] = location;
 
             if (!do_task(step, 0, 1))
                 vh_istore(task, "FINISH", 1);
@@ -299,12 +889,30 @@ do_task(vhash *task, int print, int recurse)
     return 1;
 }
 
+/* Flag an item as needing a check for dropping */
+static void
+drop_check(vhash *item)
+{
+    int pos = vh_iget(item, "BIT");
+
+    /* If it's later in the current pass, check it in that pass */
+    if (droppos >= 0 && pos > droppos) {
+        vq_pstore(dropqueue, item, -pos);
+    } else if (!vh_iget(item, "DROPCHECK")) {
+        if (droplist == NULL)
+            droplist = vl_create();
+
+        vl_ppush(droplist, item);
+        vh_istore(item, "DROPCHECK", 1);
+    }
+}
+
 /* Leave an item in a room and maybe get it later */
 static void
 drop_item(vhash *item, vhash *room, vlist *until, int print)
 {
     vhash *tstep, *step, *task;
-    vlist *list;
+    int bit, n;
     viter iter;
 
     /* Do nothing if not carrying it */
@@ -324,23 +932,45 @@ drop_item(vhash *item, vhash *room, vlist *until, int print)
         v_iterate(until, iter) {
             task = vl_iter_pval(iter);
             tstep = vh_pget(task, "STEP");
-            if (!vh_iget(tstep, "DONE"))
+            if (!STEP_TEST(STEP_ID(tstep), S_DONE))
                 order_tasks(tstep, step);
         }
     }
 
-    if ((list = vh_pget(item, "TASKS")) != NULL) {
-        v_iterate(list, iter) {
-            tstep = vl_iter_pval(iter);
-            if (!vh_iget(tstep, "DONE"))
-                order_tasks(step, tstep);
-        }
+    bit = vh_iget(item, "BIT");
+    for (n = need_start[bit]; n < need_start[bit + 1]; n++) {
+        tstep = need_steps[n];
+        if (!STEP_TEST(STEP_ID(tstep), S_DONE))
+            order_tasks(step, tstep);
     }
 
     /* If the item is still wanted, flag an optional retrieval */
     if (want_item(item)) {
         add_task(step);
-        vh_istore(step, "OPTIONAL", 1);
+        STEP_SET(STEP_ID(step), S_OPTIONAL);
+    }
+}
+
+/* Flag a task step as needing a redundancy check */
+static void
+filter_check(vhash *step)
+{
+    int id = STEP_ID(step), pos = step_order[id];
+
+    /* Only undone steps in the task list can be filtered */
+    if (STEP_TEST(id, S_DONE) || !STEP_TEST(id, S_LISTED))
+        return;
+
+    /* If it's later in the current pass, check it in that pass (queues
+     * give the highest priority first, so it's negated) */
+    if (filterpos >= 0 && pos > filterpos) {
+        vq_pstore(filterqueue, step, -pos);
+    } else if (!STEP_TEST(id, S_FILTER)) {
+        if (filterlist == NULL)
+            filterlist = vl_create();
+
+        vl_ppush(filterlist, step);
+        STEP_SET(id, S_FILTER);
     }
 }
 
@@ -348,18 +978,51 @@ drop_item(vhash *item, vhash *room, vlist *until, int print)
 static void
 filter_tasks(int print)
 {
-    int canfilter, filter, filtered, numfiltered = 0, alldone;
+    int canfilter, filter, filtered, numfiltered = 0, alldone, last, id;
     vhash *task, *otask, *item, *step;
     char *reason;
     vlist *list;
     viter i, j;
 
-    /* Loop until no more filtering possible */
+    /*
+     * Loop until no more filtering possible.  Only steps which refer to
+     * something that changed since they were last checked can have become
+     * redundant, so only those are checked.  They're checked in task list
+     * order, and filtering a step queues later ones that refer to it for
+     * this pass and earlier ones for the next, as if each pass looked at
+     * the whole list.
+     */
+    filter_calls++;
+
     do {
         filtered = 0;
+        filter_passes++;
 
-        v_iterate(tasklist, i) {
-            task = vl_iter_pval(i);
+        /* Queue up steps to check in this pass */
+        vq_init(filterqueue);
+
+        if (filterlist != NULL) {
+            v_iterate(filterlist, i) {
+                task = vl_iter_pval(i);
+                id = STEP_ID(task);
+                STEP_CLEAR(id, S_FILTER);
+                vq_pstore(filterqueue, task, -step_order[id]);
+            }
+
+            vl_empty(filterlist);
+        }
+
+        last = -1;
+
+        while (vq_length(filterqueue) > 0) {
+            task = vq_pget(filterqueue);
+            id = STEP_ID(task);
+
+            /* Skip it if it's been queued twice */
+            if ((filterpos = step_order[id]) == last)
+                continue;
+
+            last = filterpos;
 
             /* By default, can't filter */
             canfilter = 0;
@@ -368,7 +1031,7 @@ filter_tasks(int print)
             filter = 1;
 
             /* Check simple non-filtering cases */
-            if (vh_iget(task, "DONE") || vh_iget(task, "FINISH") ||
+            if (STEP_TEST(id, S_DONE) || vh_iget(task, "FINISH") ||
                 vh_iget(task, "SCORE") || vh_iget(task, "MODPATH") ||
                 vh_exists(task, "NEXT"))
                 filter = 0;
@@ -379,7 +1042,7 @@ filter_tasks(int print)
 
                 v_iterate(list, j) {
                     otask = vl_iter_pval(j);
-                    if (!vh_iget(otask, "DONE"))
+                    if (!STEP_TEST(STEP_ID(otask), S_DONE))
                         alldone = 0;
                 }
 
@@ -427,7 +1090,7 @@ filter_tasks(int print)
                 v_iterate(list, j) {
                     otask = vl_iter_pval(j);
                     step = vh_pget(otask, "STEP");
-                    if (!vh_iget(step, "DONE"))
+                    if (!STEP_TEST(STEP_ID(step), S_DONE))
                         alldone = 0;
                 }
 
@@ -436,7 +1099,7 @@ filter_tasks(int print)
             }
 
             /* Can filter get-item tasks for carried items */
-            if (!vh_iget(task, "DONE") && vh_iget(task, "TYPE") == T_GET) {
+            if (!STEP_TEST(id, S_DONE) && step_type[id] == T_GET) {
                 canfilter = 1;
                 reason = "item already carried";
                 item = vh_pget(task, "DATA");
@@ -447,17 +1110,33 @@ filter_tasks(int print)
             if (canfilter && filter) {
                 filtered++;
                 numfiltered++;
-                vh_istore(task, "DONE", 1);
+                set_done(task);
                 solver_msg(3, "redundant task: %s (%s)",
                            vh_sgetref(task, "DESC"), reason);
             }
         }
+
+        filterpos = -1;
     } while (filtered);
 
     if (numfiltered)
         modify_path(print);
 }
 
+/* Flag task steps which refer to something as needing a check */
+static void
+filter_watch(vhash *obj)
+{
+    vlist *list;
+    viter iter;
+
+    if ((list = vh_pget(obj, "RECHECK")) == NULL)
+        return;
+
+    v_iterate(list, iter)
+        filter_check(vl_iter_pval(iter));
+}
+
 /* Return first task in a task's follow-chain */
 static vhash *
 first_task(vhash *step)
@@ -488,8 +1167,12 @@ goto_room(vhash *task)
     if (room == location)
         return;
 
-    /* Add movement tasks */
-    path = get_path(task, room);
+    /* Add movement tasks, taking the same route as before if replaying */
+    if (replay_limit > 0)
+        path = replay_route;
+    else
+        path = get_path(task, room);
+
     last = location;
 
     v_iterate(path, i) {
@@ -512,20 +1195,15 @@ goto_room(vhash *task)
         }
 
         /* Move to the next room */
-        mtask = new_task(T_MOVE, room);
-        list = vh_pget(reach, "CMD");
-        vh_pstore(mtask, "CMD", list);
-        vl_ppush(taskorder, mtask);
-
-        if (vh_exists(room, "VISITED")) {
-            vh_delete(mtask, "SCORE");
-            vh_delete(mtask, "NOTE");
-        }
+        if (window_moving && !vh_exists(room, "VISITED"))
+            vl_ppush(window_visits, room);
 
-        vh_istore(room, "VISITED", 1);
+        mtask = new_move(reach);
+        vl_ppush(taskorder, mtask);
+        num_moves++;
 
-        if (vh_iget(room, "FINISH"))
-            add_attr(mtask, "NOTE", "Finishes the game");
+        if (checkpoint_route != NULL)
+            vl_ipush(checkpoint_route, vh_iget(reach, "INDEX"));
 
         solver_msg(2, "move to: %s", vh_sgetref(room, "DESC"));
         last = room;
@@ -538,30 +1216,42 @@ goto_room(vhash *task)
 static void
 invert_items(vhash *obj, char *attr)
 {
+    static unsigned long *bits = NULL;
+    int i, bit, num = vl_length(items);
     vlist *list, *newlist = NULL;
-    static int num = 0;
+    unsigned long word;
     vhash *item;
     viter iter;
 
-    list = vh_pget(obj, attr);
-    num++;
+    if (bits == NULL)
+        bits = bits_create(num);
 
-    if (list != NULL) {
+    /* Build the complement as a bit set */
+    for (i = 0; i < BITS_LEN(num); i++)
+        bits[i] = ~0UL;
+
+    if (num % BITS_WORD != 0)
+        bits[BITS_LEN(num) - 1] = (1UL << (num % BITS_WORD)) - 1;
+
+    if ((list = vh_pget(obj, attr)) != NULL) {
         v_iterate(list, iter) {
             item = vl_iter_pval(iter);
-            vh_istore(item, "INVERT", num);
+            BIT_CLEAR(bits, vh_iget(item, "BIT"));
         }
     }
 
-    v_iterate(items, iter) {
-        item = vl_iter_pval(iter);
-        if (vh_iget(item, "INVERT") == num)
-            continue;
+    /* Convert it back to a list, skipping empty words */
+    for (i = 0; i < BITS_LEN(num); i++) {
+        bit = i * BITS_WORD;
+        for (word = bits[i]; word != 0; word >>= 1, bit++) {
+            if (!(word & 1))
+                continue;
 
-        if (newlist == NULL)
-            newlist = vl_create();
+            if (newlist == NULL)
+                newlist = vl_create();
 
-        vl_ppush(newlist, item);
+            vl_ppush(newlist, item_vec[bit]);
+        }
     }
 
     vh_pstore(obj, attr, newlist);
@@ -593,12 +1283,35 @@ mark_finishing(char *action, char *otype, char *varname, vhash *table)
     vl_destroy(tags);
 }
 
+/* Create and return a movement step along a reach-element */
+static vhash *
+new_move(vhash *reach)
+{
+    vhash *mtask, *room = vh_pget(reach, "TO");
+
+    mtask = new_task(T_MOVE, room);
+    vh_pstore(mtask, "CMD", vh_pget(reach, "CMD"));
+
+    if (vh_exists(room, "VISITED")) {
+        vh_delete(mtask, "SCORE");
+        vh_delete(mtask, "NOTE");
+    }
+
+    vh_istore(room, "VISITED", 1);
+
+    if (vh_iget(room, "FINISH"))
+        add_attr(mtask, "NOTE", "Finishes the game");
+
+    return mtask;
+}
+
 /* Create and return a new task step */
 static vhash *
 new_task(int type, vhash *data)
 {
     char *desc = vh_sgetref(data, "DESC");
-    int i, score = vh_iget(data, "SCORE");
+    int i, size, score = vh_iget(data, "SCORE");
+    struct stepid *old, *entry;
     static int taskid = 0;
     vhash *room, *step;
     vscalar *val;
@@ -607,6 +1320,7 @@ new_task(int type, vhash *data)
     step = vh_create();
     vh_istore(step, "TYPE", type);
     vh_pstore(step, "DATA", data);
+    task_steps++;
 
     switch (type) {
     case T_MOVE:
@@ -653,16 +1367,94 @@ new_task(int type, vhash *data)
     vh_sstore(step, "DESC", V_BUF_VAL);
     vh_pstore(step, "ROOM", room);
     vh_istore(step, "SCORE", score);
-    vh_istore(step, "ID", taskid++);
+    vh_istore(step, "ID", taskid);
+
+    /* Add its task step table entry */
+    if (taskid == step_alloc) {
+        step_alloc = (step_alloc > 0 ? 2 * step_alloc : 256);
+
+        old = step_ids;
+        size = step_ids_size;
+        step_ids_size = 2 * step_alloc;
+        step_ids = V_CALLOC(struct stepid, step_ids_size);
+        for (i = 0; i < size; i++)
+            if (old[i].step != NULL)
+                *stepid_entry(old[i].step) = old[i];
+        V_DEALLOC(old);
+
+        step_type = V_REALLOC(step_type, int, step_alloc);
+        step_flags = V_REALLOC(step_flags, int, step_alloc);
+        step_sort = V_REALLOC(step_sort, int, step_alloc);
+        step_dist = V_REALLOC(step_dist, int, step_alloc);
+        step_order = V_REALLOC(step_order, int, step_alloc);
+        step_wait = V_REALLOC(step_wait, int, step_alloc);
+        step_room = V_REALLOC(step_room, vhash *, step_alloc);
+        safe_msg = V_REALLOC(safe_msg, char *, step_alloc);
+        safe_room = V_REALLOC(safe_room, vhash *, step_alloc);
+        safe_gen = V_REALLOC(safe_gen, int, step_alloc);
+        step_orders = V_REALLOC(step_orders, struct orderset, step_alloc);
+    }
+
+    step_type[taskid] = type;
+    step_flags[taskid] = 0;
+    step_sort[taskid] = 0;
+    step_dist[taskid] = 0;
+    step_order[taskid] = 0;
+    step_wait[taskid] = 0;
+    step_room[taskid] = room;
+    safe_room[taskid] = NULL;
+    step_orders[taskid].codes = NULL;
+    step_orders[taskid].count = step_orders[taskid].alloc = 0;
+
+    entry = stepid_entry(step);
+    entry->step = step;
+    entry->id = taskid++;
 
     return step;
 }
 
-/* Add an ordered task pair to the task list */
-static void
-order_tasks(vhash *before, vhash *after)
+/* Return whether a task ordering hasn't been recorded before */
+static int
+order_new(int type, vhash *before, vhash *after)
 {
-    vlist *allow, *depend;
+    struct orderset *set = &step_orders[STEP_ID(before)];
+    int code = 2 * STEP_ID(after) + type;
+    int lo = 0, hi = set->count, mid;
+
+    /* Look for it in the step's sorted codes */
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (set->codes[mid] < code)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo < set->count && set->codes[lo] == code) {
+        order_dups++;
+        return 0;
+    }
+
+    /* Insert it in order */
+    if (set->count == set->alloc) {
+        set->alloc = (set->alloc > 0 ? 2 * set->alloc : 4);
+        set->codes = V_REALLOC(set->codes, int, set->alloc);
+    }
+
+    memmove(set->codes + lo + 1, set->codes + lo,
+            (set->count - lo) * sizeof(int));
+    set->codes[lo] = code;
+    set->count++;
+
+    order_edges++;
+    return 1;
+}
+
+/* Add an ordered task pair to the task list */
+static void
+order_tasks(vhash *before, vhash *after)
+{
+    vlist *allow, *depend;
     int count = 0;
     vhash *step;
 
@@ -672,13 +1464,20 @@ order_tasks(vhash *before, vhash *after)
 
     if (before != after) {
         /* The 'before' task allows the 'after' one to be done */
-        add_list(before, "ALLOW", after);
+        if (order_new(O_ALLOW, before, after)) {
+            add_list(before, "ALLOW", after);
+            add_list(after, "RECHECK", before);
+        }
 
         /* The 'after' task (and previous ones in its follow-chain)
          * depends on the 'before' one */
         for (step = after; step != NULL; step = vh_pget(step, "PREV")) {
-            if (step != before) {
+            if (step != before && order_new(O_DEPEND, before, step)) {
                 add_list(step, "DEPEND", before);
+                add_list(before, "RELEASE", step);
+                if (!STEP_TEST(STEP_ID(before), S_DONE))
+                    step_wait[STEP_ID(step)]++;
+
                 solver_msg(2, "task order: do '%s' before '%s'",
                            vh_sgetref(before, "DESC"),
                            vh_sgetref(step, "DESC"));
@@ -691,6 +1490,42 @@ order_tasks(vhash *before, vhash *after)
     }
 }
 
+/* Return the list of task steps to consider doing next */
+static vlist *
+ready_tasks(vhash *next)
+{
+    static vlist *list = NULL;
+    vhash *step;
+    viter iter;
+    int id;
+
+    vl_init(list);
+
+    /* If there's a forced next task, that's the only one */
+    if (next != NULL) {
+        vl_ppush(list, next);
+        return list;
+    }
+
+    /* Weed out steps which are done or waiting again */
+    v_iterate(readylist, iter) {
+        step = vl_iter_pval(iter);
+        id = STEP_ID(step);
+        if (STEP_TEST(id, S_DONE) || step_wait[id])
+            STEP_CLEAR(id, S_READY);
+        else
+            vl_ppush(list, step);
+    }
+
+    vl_empty(readylist);
+    vl_append(readylist, list);
+
+    /* Put them in task list order */
+    vl_sort(readylist, sort_ready);
+
+    return readylist;
+}
+
 /* Return a task required by a given task, if any */
 vhash *
 require_task(vhash *step)
@@ -699,31 +1534,454 @@ require_task(vhash *step)
     vlist *depend;
     viter iter;
 
+    if (!step_wait[STEP_ID(step)])
+        return NULL;
+
     if ((depend = vh_pget(step, "DEPEND")) == NULL)
         return NULL;
 
     v_iterate(depend, iter) {
         before = vl_iter_pval(iter);
-        if (!vh_iget(before, "DONE"))
+        if (!STEP_TEST(STEP_ID(before), S_DONE))
             return before;
     }
 
     return NULL;
 }
 
+/* Choose one of the safe tasks to do next */
+static vhash *
+search_choose(vlist *list)
+{
+    int num = vl_length(list), choice, alt = 0;
+
+    if (num == 1)
+        return vl_pget(list, 0);
+
+    choice = search_count++;
+
+    if (choice < search_len)
+        alt = V_MIN(search_alts[choice], num - 1);
+    else if (search_out != NULL)
+        fprintf(search_out, "c %d %d %d\n", choice, num, num_moves);
+
+    return vl_pget(list, alt);
+}
+
+/* Compare two lists of search choices */
+static int
+search_cmp(vlist *alts1, vlist *alts2)
+{
+    int i, len1 = vl_length(alts1), len2 = vl_length(alts2);
+
+    for (i = 0; i < len1 && i < len2; i++)
+        if (vl_iget(alts1, i) != vl_iget(alts2, i))
+            return vl_iget(alts1, i) - vl_iget(alts2, i);
+
+    return len1 - len2;
+}
+
+/* Report the result of a search worker and exit */
+static void
+search_exit(int status)
+{
+    int missed = 0;
+    vhash *step;
+    viter iter;
+
+    /* Add up the score of tasks left undone */
+    v_iterate(tasklist, iter) {
+        step = vl_iter_pval(iter);
+        if (!STEP_TEST(STEP_ID(step), S_DONE | S_OPTIONAL))
+            missed += vh_iget(step, "SCORE");
+    }
+
+    fprintf(search_out, "r %d %d %d\n", status, missed, num_moves);
+    fflush(search_out);
+    exit(0);
+}
+
+/* Set up to follow a list of search choices */
+static void
+search_follow(vlist *alts)
+{
+    int i;
+
+    search_len = 0;
+    for (i = 0; i < vl_length(alts); i += 2)
+        search_len = vl_iget(alts, i) + 1;
+
+    search_alts = V_ALLOC(int, search_len + 1);
+    for (i = 0; i < search_len; i++)
+        search_alts[i] = 0;
+
+    for (i = 0; i < vl_length(alts); i += 2)
+        search_alts[vl_iget(alts, i)] = vl_iget(alts, i + 1);
+
+    search_count = 0;
+}
+
+/* Search for a solution with fewer moves than the greedy one */
+static void
+search_game(void)
+{
+#ifdef USE_FORK
+    int i, alt, jobs, depth, choice, num, moves, missed, status, bound;
+    int found = 0, bestmissed = 0, bestmoves = 0, greedy = -1;
+    int greedymissed = 0;
+    int tried = 0, running, finished;
+    vlist *queue, *alts, *newalts, *bestalts = NULL;
+    struct timeval start, now;
+    struct timespec pause;
+    double limit, elapsed;
+    vhash *job, *newjob, **slots;
+    char tag;
+    FILE *fp;
+
+    solver_msg(0, "\nSearching for a shorter solution...");
+
+    if ((jobs = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+        jobs = 1;
+
+    depth = var_int("solver_search_depth");
+    limit = var_real("solver_time_limit");
+
+    slots = V_ALLOC(vhash *, jobs);
+    for (i = 0; i < jobs; i++)
+        slots[i] = NULL;
+
+    /*
+     * Each job follows a list of (choice point, alternative) pairs, and
+     * is done by a forked copy of the solver.  It reports the choice
+     * points it passes after its last listed one, and each of those
+     * (unless too deep, or already past the best no. of moves) gives
+     * new jobs which take the other alternatives there.  Jobs which
+     * can't beat the best solution found so far give up early.  The
+     * first job makes no alternative choices, so it finds the greedy
+     * solution.
+     */
+    queue = vl_create();
+    job = vh_create();
+    vh_pstore(job, "ALTS", vl_create());
+    vl_ppush(queue, job);
+
+    gettimeofday(&start, NULL);
+    pause.tv_sec = 0;
+    pause.tv_nsec = 1000000;
+    running = 0;
+
+    while (1) {
+        gettimeofday(&now, NULL);
+        elapsed = (now.tv_sec - start.tv_sec) +
+            (now.tv_usec - start.tv_usec) / 1.0e6;
+
+        /* Start new jobs in free slots */
+        bound = (found && bestmissed == 0 ? bestmoves : 0);
+
+        for (i = 0; i < jobs && elapsed < limit; i++) {
+            if (slots[i] != NULL)
+                continue;
+
+            /* Skip jobs which can't beat the best solution */
+            job = NULL;
+            while (job == NULL && vl_length(queue) > 0) {
+                job = vl_pshift(queue);
+                if (bound > 0 && vh_iget(job, "MOVES") > bound) {
+                    vl_destroy(vh_pget(job, "ALTS"));
+                    vh_destroy(job);
+                    job = NULL;
+                }
+            }
+
+            if (job == NULL)
+                break;
+
+            search_start(job, bound);
+            slots[i] = job;
+            running++;
+            tried++;
+        }
+
+        if (running == 0)
+            break;
+
+        /* Stop any jobs still running if out of time */
+        if (elapsed >= limit) {
+            for (i = 0; i < jobs; i++) {
+                if ((job = slots[i]) == NULL)
+                    continue;
+
+                kill(vh_iget(job, "PID"), SIGKILL);
+                waitpid(vh_iget(job, "PID"), &status, 0);
+                fclose(vh_pget(job, "FILE"));
+                vl_destroy(vh_pget(job, "ALTS"));
+                vh_destroy(job);
+            }
+
+            solver_msg(1, "search: out of time");
+            break;
+        }
+
+        /* Deal with finished jobs */
+        finished = 0;
+
+        for (i = 0; i < jobs; i++) {
+            if ((job = slots[i]) == NULL)
+                continue;
+
+            if (waitpid(vh_iget(job, "PID"), &status, WNOHANG) <= 0)
+                continue;
+
+            slots[i] = NULL;
+            running--;
+            finished++;
+
+            alts = vh_pget(job, "ALTS");
+            fp = vh_pget(job, "FILE");
+            rewind(fp);
+            status = -1;
+            missed = 0;
+
+            while (fscanf(fp, " %c %d %d %d",
+                          &tag, &choice, &num, &moves) == 4) {
+                if (tag == 'r') {
+                    status = choice;
+                    missed = num;
+                } else if (vl_length(alts) / 2 < depth &&
+                           (bound == 0 || moves <= bound)) {
+                    /* Try the other alternatives at this choice point */
+                    for (alt = 1; alt < num; alt++) {
+                        newalts = vl_copy(alts);
+                        vl_ipush(newalts, choice);
+                        vl_ipush(newalts, alt);
+
+                        newjob = vh_create();
+                        vh_pstore(newjob, "ALTS", newalts);
+                        vh_istore(newjob, "MOVES", moves);
+                        vl_ppush(queue, newjob);
+                    }
+                }
+            }
+
+            fclose(fp);
+            vh_destroy(job);
+
+            if (status == 0 && vl_length(alts) == 0) {
+                greedy = moves;
+                greedymissed = missed;
+            }
+
+            /* If the greedy solution finished the game, it's the bound:
+             * others mustn't miss more points, and are ranked only by
+             * moves.  If not, ones missing fewer points are better */
+            if (greedy >= 0) {
+                if (missed > greedymissed)
+                    status = -1;
+                missed = 0;
+            }
+
+            /* Record it if it's the best solution so far */
+            if (status == 0 &&
+                (!found || missed < bestmissed ||
+                 (missed == bestmissed && moves < bestmoves) ||
+                 (missed == bestmissed && moves == bestmoves &&
+                  search_cmp(alts, bestalts) < 0))) {
+                if (bestalts != NULL)
+                    vl_destroy(bestalts);
+
+                bestalts = alts;
+                bestmissed = missed;
+                bestmoves = moves;
+                found = 1;
+            } else {
+                vl_destroy(alts);
+            }
+        }
+
+        if (finished == 0)
+            nanosleep(&pause, NULL);
+    }
+
+    solver_msg(1, "search: %d solutions tried", tried);
+
+    if (greedy >= 0)
+        solver_msg(1, "search: greedy solution has %d moves", greedy);
+
+    if (found) {
+        solver_msg(1, "search: best solution has %d moves", bestmoves);
+        search_follow(bestalts);
+        vl_destroy(bestalts);
+    }
+
+    while (vl_length(queue) > 0) {
+        job = vl_pshift(queue);
+        vl_destroy(vh_pget(job, "ALTS"));
+        vh_destroy(job);
+    }
+
+    vl_destroy(queue);
+    V_DEALLOC(slots);
+#else
+    warn("solver search mode not available -- using greedy mode");
+#endif
+}
+
+#ifdef USE_FORK
+/* Start a search worker process on a job */
+static void
+search_start(vhash *job, int bound)
+{
+    int pid;
+    FILE *fp;
+
+    if ((fp = tmpfile()) == NULL)
+        fatal("can't create solver search file");
+
+    fflush(NULL);
+
+    if ((pid = fork()) < 0)
+        fatal("can't start solver search process");
+
+    if (pid > 0) {
+        vh_istore(job, "PID", pid);
+        vh_pstore(job, "FILE", fp);
+        return;
+    }
+
+    /* Worker -- follow the job's choices and report back */
+    if (freopen("/dev/null", "w", stdout) == NULL ||
+        freopen("/dev/null", "w", stderr) == NULL)
+        exit(1);
+
+    search_follow(vh_pget(job, "ALTS"));
+    search_out = fp;
+    search_bound = bound;
+
+    search_exit(solve_tasks() ? 0 : 1);
+}
+#endif
+
+/* Flag a task step as done */
+static void
+set_done(vhash *step)
+{
+    int id = STEP_ID(step);
+    vhash *after, *item;
+    vlist *list;
+    viter iter;
+
+    if (STEP_TEST(id, S_DONE))
+        return;
+
+    if (vh_iget(step, "MODPATH"))
+        window_flush();
+
+    STEP_SET(id, S_DONE);
+
+    if (vh_exists(step, "BIT"))
+        BIT_SET(done_tasks, vh_iget(step, "BIT"));
+
+    if (checkpoint_done != NULL && step_type[id] == T_USER)
+        vl_spush(checkpoint_done, checkpoint_key(step));
+
+    /* Items wanted for it might not be wanted any more */
+    if ((list = vh_pget(step, "WANTS")) != NULL) {
+        v_iterate(list, iter) {
+            item = vl_iter_pval(iter);
+            vh_istore(item, "WANTED", vh_iget(item, "WANTED") - 1);
+            if (vh_iget(item, "WANTED") == 0)
+                drop_check(item);
+        }
+    }
+
+    /* Recheck steps which refer to it */
+    filter_watch(step);
+    if (step_type[id] == T_USER)
+        filter_watch(vh_pget(step, "DATA"));
+
+    /* Release steps waiting for this one */
+    if ((list = vh_pget(step, "RELEASE")) != NULL) {
+        v_iterate(list, iter) {
+            after = vl_iter_pval(iter);
+            step_wait[STEP_ID(after)]--;
+            set_ready(after);
+        }
+    }
+}
+
+/* Add a task step to the ready list if it's ready */
+static void
+set_ready(vhash *step)
+{
+    int id = STEP_ID(step);
+
+    if (STEP_TEST(id, S_READY | S_DONE) || step_wait[id] ||
+        !STEP_TEST(id, S_LISTED))
+        return;
+
+    if (readylist == NULL)
+        readylist = vl_create();
+
+    vl_ppush(readylist, step);
+    STEP_SET(id, S_READY);
+}
+
+/* Flag whether an item is carried */
+static void
+set_taken(vhash *item, int flag)
+{
+    int held = !vh_exists(item, "TAKEN") || vh_iget(item, "TAKEN");
+    vhash *oitem;
+    vlist *list;
+    viter iter;
+
+    /* Paths might change, so reorder tasks done before now */
+    window_flush();
+
+    vh_istore(item, "TAKEN", flag);
+    filter_watch(item);
+
+    /* Update counts of items kept with it */
+    if (flag != held && (list = vh_pget(item, "KEEPS")) != NULL) {
+        v_iterate(list, iter) {
+            oitem = vl_iter_pval(iter);
+            vh_istore(oitem, "KEPT", vh_iget(oitem, "KEPT") + flag - held);
+            if (vh_iget(oitem, "KEPT") == 0)
+                drop_check(oitem);
+        }
+    }
+
+    /* It might not be wanted */
+    if (flag)
+        drop_check(item);
+
+    if (flag)
+        BIT_SET(taken_items, vh_iget(item, "BIT"));
+    else
+        BIT_CLEAR(taken_items, vh_iget(item, "BIT"));
+}
+
 /* Build the initial task list */
 void
 setup_tasks(void)
 {
     vhash *task, *otask, *get, *after, *item, *tstep, *room, *reach;
     vhash *step, *istep, *oitem, *first;
-    vlist *list, *itasks, *rlist;
-    int flagged = 1;
+    vlist *list, *rlist, *queue;
+    int num = 0, bit, n;
     viter i, j, k;
     char *msg;
 
     solver_msg(0, "\nSetting up tasks...");
 
+    /* Give items bit indices */
+    item_vec = V_ALLOC(vhash *, vl_length(items) + 1);
+    v_iterate(items, i) {
+        item = vl_iter_pval(i);
+        item_vec[num] = item;
+        vh_istore(item, "BIT", num++);
+    }
+
     /* Flag any extra rooms/items/tasks as finishing things */
     solver_msg(1, "Marking extra events that finish the game");
     mark_finishing("entering", "room", "finish_room", roomtags);
@@ -992,6 +2250,9 @@ setup_tasks(void)
         }
     }
 
+    /* Index the steps needing each item */
+    setup_needs();
+
     /* Process task 'lose' stuff */
     solver_msg(1, "Adding dependencies for task 'lose' lists");
 
@@ -1003,12 +2264,9 @@ setup_tasks(void)
             v_iterate(list, j) {
                 item = vl_iter_pval(j);
 
-                if ((itasks = vh_pget(item, "TASKS")) != NULL) {
-                    v_iterate(itasks, k) {
-                        step = vl_iter_pval(k);
-                        order_tasks(step, tstep);
-                    }
-                }
+                bit = vh_iget(item, "BIT");
+                for (n = need_start[bit]; n < need_start[bit + 1]; n++)
+                    order_tasks(need_steps[n], tstep);
 
                 /* If item is needed for paths, mark task unsafe */
                 if (vh_exists(item, "NEEDED"))
@@ -1022,40 +2280,159 @@ setup_tasks(void)
         task = vl_iter_pval(i);
         tstep = vh_pget(task, "STEP");
 
-        if (vh_exists(tstep, "PREV") &&
-            vh_exists(tstep, "UNSAFE") &&
-            !vh_iget(tstep, "SAFE")) {
-            step = vh_pget(tstep, "PREV");
-            msg = vh_sgetref(tstep, "UNSAFE");
-            while (step != NULL) {
+        /* Walk each follow chain once, from its last task back */
+        if (!vh_exists(tstep, "PREV") || vh_exists(tstep, "NEXT"))
+            continue;
+
+        msg = NULL;
+        for (step = tstep; step != NULL; step = vh_pget(step, "PREV")) {
+            if (vh_exists(step, "UNSAFE")) {
+                if (!vh_iget(step, "SAFE"))
+                    msg = vh_sgetref(step, "UNSAFE");
+            } else if (msg != NULL) {
                 vh_sstore(step, "UNSAFE", msg);
-                step = vh_pget(step, "PREV");
             }
         }
     }
 
     /* Propagate 'unsafe' flags for 'do' tasks */
-    while (flagged) {
-        flagged = 0;
+    queue = vl_create();
 
-        v_iterate(tasks, i) {
-            task = vl_iter_pval(i);
-            tstep = vh_pget(task, "STEP");
+    v_iterate(tasks, i) {
+        task = vl_iter_pval(i);
+        tstep = vh_pget(task, "STEP");
+        if ((list = vh_pget(tstep, "DO")) == NULL)
+            continue;
+
+        v_iterate(list, j) {
+            otask = vl_iter_pval(j);
+            step = vh_pget(otask, "STEP");
+            if (!vh_exists(step, "DONEBY") && vh_defined(step, "UNSAFE"))
+                vl_ppush(queue, step);
+            add_list(step, "DONEBY", tstep);
+        }
+    }
+
+    while (vl_length(queue) > 0) {
+        step = vl_pshift(queue);
+        list = vh_pget(step, "DONEBY");
+
+        v_iterate(list, j) {
+            tstep = vl_iter_pval(j);
             if (vh_defined(tstep, "UNSAFE"))
                 continue;
 
-            if ((list = vh_pget(tstep, "DO")) == NULL)
-                continue;
+            vh_sstore(tstep, "UNSAFE", "does unsafe task");
+            if (vh_exists(tstep, "DONEBY"))
+                vl_ppush(queue, tstep);
+        }
+    }
+
+    vl_destroy(queue);
+
+    v_iterate(tasks, i) {
+        task = vl_iter_pval(i);
+        tstep = vh_pget(task, "STEP");
+        vh_delete(tstep, "DONEBY");
+    }
+}
+
+/* Index the task steps that need each item */
+static void
+setup_needs(void)
+{
+    int bit = 0, num = 0, count = 0, id, *seen;
+    vhash *item, *step;
+    vlist *list;
+    viter i, j;
 
+    v_iterate(items, i) {
+        item = vl_iter_pval(i);
+        if ((list = vh_pget(item, "TASKS")) != NULL)
+            count += vl_length(list);
+    }
+
+    need_start = V_ALLOC(int, vl_length(items) + 1);
+    need_steps = V_ALLOC(vhash *, count + 1);
+
+    /* Items are in bit order, and each step is listed once per item */
+    seen = V_ALLOC(int, step_alloc + 1);
+    for (id = 0; id < step_alloc; id++)
+        seen[id] = -1;
+
+    v_iterate(items, i) {
+        item = vl_iter_pval(i);
+        need_start[bit] = num;
+
+        if ((list = vh_pget(item, "TASKS")) != NULL) {
             v_iterate(list, j) {
-                otask = vl_iter_pval(j);
-                step = vh_pget(otask, "STEP");
-                if (vh_defined(step, "UNSAFE")) {
-                    vh_sstore(tstep, "UNSAFE", "does unsafe task");
-                    flagged = 1;
+                step = vl_iter_pval(j);
+                id = STEP_ID(step);
+                if (seen[id] != bit) {
+                    seen[id] = bit;
+                    need_steps[num++] = step;
                 }
             }
         }
+
+        bit++;
+    }
+
+    need_start[bit] = num;
+    V_DEALLOC(seen);
+}
+
+/* Count the reasons for keeping each item */
+static void
+setup_wants(void)
+{
+    vhash *item, *kitem, *task, *step;
+    int bit = 0, count, n;
+    vlist *list;
+    viter i, j;
+
+    v_iterate(items, i) {
+        item = vl_iter_pval(i);
+
+        /* Count tasks that need it, and 'keep until' tasks */
+        count = 0;
+
+        for (n = need_start[bit]; n < need_start[bit + 1]; n++) {
+            step = need_steps[n];
+            add_list(step, "WANTS", item);
+            if (!STEP_TEST(STEP_ID(step), S_DONE))
+                count++;
+        }
+
+        bit++;
+
+        if ((list = vh_pget(item, "KEEP_UNTIL")) != NULL) {
+            v_iterate(list, j) {
+                task = vl_iter_pval(j);
+                step = vh_pget(task, "STEP");
+                add_list(step, "WANTS", item);
+                if (!STEP_TEST(STEP_ID(step), S_DONE))
+                    count++;
+            }
+        }
+
+        vh_istore(item, "WANTED", count);
+
+        /* Count 'keep with' items that are held */
+        count = 0;
+
+        if ((list = vh_pget(item, "KEEP_WITH")) != NULL) {
+            v_iterate(list, j) {
+                kitem = vl_iter_pval(j);
+                add_list(kitem, "KEEPS", item);
+                if (!vh_exists(kitem, "TAKEN") || vh_iget(kitem, "TAKEN"))
+                    count++;
+            }
+        }
+
+        vh_istore(item, "KEPT", count);
+
+        drop_check(item);
     }
 }
 
@@ -1063,9 +2440,9 @@ setup_tasks(void)
 void
 solve_game(void)
 {
-    int count, tasksleft, status, ignore = 0;
-    vhash *step, *trystep, *item, *next;
+    vhash *step, *item;
     viter iter;
+    int num;
 
     /* Don't bother if no tasks */
     if (tasklist == NULL || vl_length(tasklist) == 0)
@@ -1074,16 +2451,61 @@ solve_game(void)
     /* Set control variables */
     all_tasks_safe = var_int("all_tasks_safe");
     keep_unused_items = var_int("keep_unused_items");
+    search_mode = (strcmp(var_string("solver_mode"), "search") == 0);
+    reorder_tasks = var_int("solver_reorder_tasks");
+
+    /* Give user tasks bit indices */
+    taken_items = bits_create(vl_length(items));
+    done_tasks = bits_create(vl_length(tasks));
+
+    num = 0;
+    v_iterate(tasks, iter) {
+        step = vh_pget(vl_iter_pval(iter), "STEP");
+        vh_istore(step, "BIT", num++);
+    }
 
     /* Build initial inventory */
     v_iterate(items, iter) {
         item = vl_iter_pval(iter);
         if (vh_pget(item, "ROOM") == NULL)
-            vh_istore(item, "TAKEN", 1);
+            set_taken(item, 1);
     }
 
-    /* Process task list */
+    /* Count reasons for keeping items */
+    setup_wants();
+
+    /* Compile path conditions for the solver */
+    compile_paths();
+
+    /* Start in the start room */
     MOVETO(startroom);
+
+    /* Look for a shorter solution first, if required */
+    if (search_mode)
+        search_game();
+
+    /* If not, see how much of the last solution can be replayed */
+    if (!search_mode && !reorder_tasks)
+        checkpoint_load();
+
+    /* Process task list */
+    solve_tasks();
+    checkpoint_save();
+
+    path_stats();
+    solver_msg(0, "");
+}
+
+/* Do tasks until there are none left, and return whether all got done */
+static int
+solve_tasks(void)
+{
+    int count, tasksleft, status, last, safe, join, replay, ignore = 0;
+    vhash *step, *trystep, *item, *next;
+    static vlist *safelist = NULL;
+    vlist *list;
+    viter iter;
+
     next = NULL;
 
     solver_msg(0, "\nSolving game...");
@@ -1091,18 +2513,44 @@ solve_game(void)
     do {
         solver_msg(1, "Location: %s", location_desc);
 
-        /* Initialise path searches from this room */
-        if (location != NULL)
+        /* Initialise path searches from this room, unless replaying */
+        replay = (replay_limit > 0);
+        if (location != NULL && !replay)
             init_path(location);
 
         /* Check for dropping unneeded items */
         if (next == NULL &&
             (location == NULL || !vh_iget(location, "NODROP"))) {
+            /*
+             * Only items which have become unwanted or been picked up
+             * since they were last looked at are checked, in item list
+             * order.  Dropping an item queues the ones kept with it.
+             */
             while (1) {
                 count = 0;
 
-                v_iterate(items, iter) {
-                    item = vl_iter_pval(iter);
+                vq_init(dropqueue);
+
+                if (droplist != NULL) {
+                    v_iterate(droplist, iter) {
+                        item = vl_iter_pval(iter);
+                        vh_delete(item, "DROPCHECK");
+                        vq_pstore(dropqueue, item, -vh_iget(item, "BIT"));
+                    }
+
+                    vl_empty(droplist);
+                }
+
+                last = -1;
+
+                while (vq_length(dropqueue) > 0) {
+                    item = vq_pget(dropqueue);
+
+                    /* Skip if already checked in this pass */
+                    if ((droppos = vh_iget(item, "BIT")) == last)
+                        continue;
+
+                    last = droppos;
 
                     /* Skip if not carried */
                     if (!vh_iget(item, "TAKEN"))
@@ -1122,67 +2570,89 @@ solve_game(void)
                     count++;
                 }
 
+                droppos = -1;
+
                 if (count == 0)
                     break;
             }
         }
 
-        /* Search for next task */
-        step = NULL;
-        tasksleft = 0;
+        /* Replay the previous run's choice, if possible */
+        safe = 0;
+        if ((step = checkpoint_next(next)) == NULL) {
+            /* If replay has just stopped, paths need initialising */
+            if (replay && location != NULL)
+                init_path(location);
 
-        v_iterate(tasklist, iter) {
-            trystep = vl_iter_pval(iter);
+            /* Search for next task */
+            list = ready_tasks(next);
+            vl_init(safelist);
 
-            /* If task is done, skip it */
-            if (vh_iget(trystep, "DONE"))
-                continue;
+            v_iterate(list, iter) {
+                trystep = vl_iter_pval(iter);
 
-            /* If not optional, flag at least one task still to do */
-            if (!vh_iget(trystep, "OPTIONAL"))
-                tasksleft = 1;
+                /* If task is done, skip it */
+                if (STEP_TEST(STEP_ID(trystep), S_DONE))
+                    continue;
 
-            /* If there's a forced next task but this isn't it, skip it */
-            if (next != NULL && trystep != next)
-                continue;
+                /* Check task is possible */
+                if ((status = task_status(location, trystep)) == TS_INVALID)
+                    continue;
 
-            /* Check task is possible */
-            if ((status = task_status(location, trystep)) == TS_INVALID)
-                continue;
+                /* Check task isn't ignored */
+                if (status == TS_IGNORED) {
+                    ignore++;
+                    continue;
+                }
 
-            /* Check task isn't ignored */
-            if (status == TS_IGNORED) {
-                ignore++;
-                continue;
+                if (status == TS_SAFE || all_tasks_safe) {
+                    /* A safe task -- choose it */
+                    step = trystep;
+                    safe = 1;
+                    if (!search_mode)
+                        break;
+
+                    /* Or, if searching, one of the first few */
+                    vl_ppush(safelist, step);
+                    if (vl_length(safelist) == SEARCH_WIDTH)
+                        break;
+                } else if (step == NULL) {
+                    /* The closest unsafe task */
+                    step = trystep;
+                }
             }
 
-            if (status == TS_SAFE || all_tasks_safe) {
-                /* A safe task -- choose it */
-                step = trystep;
-                break;
-            } else if (step == NULL) {
-                /* The closest unsafe task */
-                step = trystep;
-            }
+            if (search_mode && vl_length(safelist) > 0)
+                step = search_choose(safelist);
         }
 
         if (step != NULL) {
             /* Do the task */
+            checkpoint_record(step);
+            join = window_join(step, safe);
             goto_room(step);
+            if (search_bound > 0 && num_moves > search_bound)
+                search_exit(2);
+
             tasksleft = do_task(step, 1, 0);
             next = vh_pget(step, "NEXT");
-        } else if (tasksleft) {
+
+            if (join)
+                window_add(step);
+        } else if ((tasksleft = tasks_left()) != 0) {
             /* Hmm... we seem to be stuck */
+            window_flush();
             warn_failure();
             if (ignore)
                 solver_msg(2, "%d ignored tasks", ignore);
-            break;
+            return 0;
         } else {
             solver_msg(2, "no more tasks");
         }
     } while (tasksleft);
 
-    solver_msg(0, "");
+    window_flush();
+    return 1;
 }
 
 /* Print solver message */
@@ -1199,6 +2669,61 @@ solver_msg(int level, char *fmt, ...)
     }
 }
 
+/* Sort task steps by their position in the task list */
+static int
+sort_ready(vscalar **v1, vscalar **v2)
+{
+    vhash *t1 = vs_pget(*v1);
+    vhash *t2 = vs_pget(*v2);
+
+    return step_order[STEP_ID(t1)] - step_order[STEP_ID(t2)];
+}
+
+/* Return the ID of a task step */
+int
+step_id(vhash *step)
+{
+    struct stepid *entry = NULL;
+
+    if (step_ids != NULL)
+        entry = stepid_entry(step);
+
+    if (entry == NULL || entry->step == NULL)
+        fatal("internal: task step has no ID");
+
+    return entry->id;
+}
+
+/* Return the step ID table entry for a step (or the empty slot for it) */
+static struct stepid *
+stepid_entry(vhash *step)
+{
+    unsigned long pos = (unsigned long) step;
+    struct stepid *entry;
+
+    pos = (pos >> 4) ^ (pos >> 12);
+
+    while (1) {
+        entry = &step_ids[pos & (step_ids_size - 1)];
+        if (entry->step == NULL || entry->step == step)
+            return entry;
+        pos++;
+    }
+}
+
+/* Record task solver statistics */
+void
+task_counts(vhash *stats)
+{
+    vh_dstore(stats, "new_task_calls", task_steps);
+    vh_dstore(stats, "filter_tasks_calls", filter_calls);
+    vh_dstore(stats, "filter_tasks_passes", filter_passes);
+    vh_dstore(stats, "safety_checks", safe_checks);
+    vh_dstore(stats, "safety_reused", safe_hits);
+    vh_dstore(stats, "order_edges", order_edges);
+    vh_dstore(stats, "order_duplicates", order_dups);
+}
+
 /* Build task dependency graph */
 vgraph *
 task_graph(void)
@@ -1243,22 +2768,22 @@ static int
 task_status(vhash *room, vhash *step)
 {
     vhash *taskroom, *gotoroom, *droproom;
+    int len = 0, id = STEP_ID(step);
     char *safemsg = NULL;
-    int len = 0;
 
     /* All dependent tasks must be done */
     if (require_task(step) != NULL)
         return TS_INVALID;
 
     /* Task must not be ignored */
-    if (vh_iget(step, "IGNORED"))
+    if (STEP_TEST(id, S_IGNORED))
         return TS_INVALID;
 
     if (vh_iget(step, "IGNORE")) {
-        if (!vh_iget(step, "IGNORED")) {
+        if (!STEP_TEST(id, S_IGNORED)) {
             solver_msg(2, "consider: %s", vh_sgetref(step, "DESC"));
             solver_msg(3, "not possible: explicitly ignored");
-            vh_istore(step, "IGNORED", 1);
+            STEP_SET(id, S_IGNORED);
         }
 
         return TS_IGNORED;
@@ -1267,7 +2792,7 @@ task_status(vhash *room, vhash *step)
     solver_msg(2, "consider: %s", vh_sgetref(step, "DESC"));
 
     /* If task is done elsewhere, make sure you can get there */
-    taskroom = vh_pget(step, "ROOM");
+    taskroom = step_room[id];
     gotoroom = vh_pget(step, "GOTO");
 
     if (taskroom != NULL && room != NULL && taskroom != room)
@@ -1280,6 +2805,11 @@ task_status(vhash *room, vhash *step)
     } else if (vh_exists(step, "UNSAFE")) {
         /* It's been flagged unsafe already */
         safemsg = vh_sgetref(step, "UNSAFE");
+    } else if (room != NULL && safe_room[id] == room &&
+               safe_gen[id] == path_generation()) {
+        /* Paths haven't changed since it was last checked from here */
+        safemsg = safe_msg[id];
+        safe_hits++;
     } else {
         /* If no return path, mark it as unsafe */
         if (gotoroom == NULL)
@@ -1301,6 +2831,11 @@ task_status(vhash *room, vhash *step)
             if (find_path(NULL, gotoroom, droproom) == NOPATH)
                 safemsg = "no path to dropped items";
         }
+
+        safe_msg[id] = safemsg;
+        safe_room[id] = room;
+        safe_gen[id] = path_generation();
+        safe_checks++;
     }
 
     if (TASK_VERBOSE) {
@@ -1319,14 +2854,24 @@ task_status(vhash *room, vhash *step)
     return (safemsg == NULL ? TS_SAFE : TS_UNSAFE);
 }
 
-/* Return whether an item is wanted */
+/* Return the no. of non-optional tasks left to do */
 static int
-want_item(vhash *item)
+tasks_left(void)
 {
-    vhash *kitem, *task, *step;
-    vlist *tasks, *kitems;
+    int count = 0;
     viter iter;
 
+    v_iterate(tasklist, iter)
+        if (!STEP_TEST(STEP_ID(vl_iter_pval(iter)), S_DONE | S_OPTIONAL))
+            count++;
+
+    return count;
+}
+
+/* Return whether an item is wanted */
+static int
+want_item(vhash *item)
+{
     /* Yes if needed for movement */
     if (vh_iget(item, "NEEDED"))
         return 1;
@@ -1336,32 +2881,13 @@ want_item(vhash *item)
         return 1;
 
     /* Yes if at least one 'keep with' item is held */
-    if ((kitems = vh_pget(item, "KEEP_WITH")) != NULL) {
-        v_iterate(kitems, iter) {
-            kitem = vl_iter_pval(iter);
-            if (!vh_exists(kitem, "TAKEN") || vh_iget(kitem, "TAKEN"))
-                return 1;
-        }
-    }
-
-    /* Yes if at least one 'keep until' task isn't done yet */
-    if ((tasks = vh_pget(item, "KEEP_UNTIL")) != NULL) {
-        v_iterate(tasks, iter) {
-            task = vl_iter_pval(iter);
-            step = vh_pget(task, "STEP");
-            if (!vh_iget(step, "DONE"))
-                return 1;
-        }
-    }
+    if (vh_iget(item, "KEPT"))
+        return 1;
 
-    /* Yes if it's needed for at least one task */
-    if ((tasks = vh_pget(item, "TASKS")) != NULL) {
-        v_iterate(tasks, iter) {
-            task = vl_iter_pval(iter);
-            if (!vh_iget(task, "DONE"))
-                return 1;
-        }
-    }
+    /* Yes if at least one 'keep until' task isn't done yet, or it's
+     * needed for at least one task */
+    if (vh_iget(item, "WANTED"))
+        return 1;
 
     /* Otherwise, no */
     return 0;
@@ -1382,14 +2908,14 @@ warn_failure(void)
     reasons = vh_create();
     v_iterate(tasklist, iter) {
         step = vl_iter_pval(iter);
-        if (vh_iget(step, "DONE"))
+        if (STEP_TEST(STEP_ID(step), S_DONE))
             continue;
 
         count++;
         tdesc = vh_sgetref(step, "DESC");
 
         /* Build failure reason */
-        if (vh_iget(step, "IGNORED")) {
+        if (STEP_TEST(STEP_ID(step), S_IGNORED)) {
             V_BUF_SET("ignored");
             rdesc = NULL;
         } else if (require_task(step) != NULL) {
@@ -1437,3 +2963,277 @@ warn_failure(void)
     warn("can't solve game (%d task%s not done)\n%s",
          count, (count == 1 ? "" : "s"), V_BUF_VAL);
 }
+
+/* Add a task to the window, and reorder it if it's full */
+static void
+window_add(vhash *step)
+{
+    /* Don't bother if something changed on the way to it */
+    if (!window_moving)
+        return;
+
+    window_moving = 0;
+    vl_ppush(window, step);
+    STEP_SET(STEP_ID(step), S_WINDOW);
+    window_end = vl_length(taskorder);
+
+    if (vl_length(window) == WINDOW_SIZE)
+        window_flush();
+}
+
+/* Return path length needed to do the window tasks in a given order */
+static int
+window_cost(int *order, int num, int *dist)
+{
+    int i, cost = 0, from = 0;
+
+    for (i = 0; i < num; i++) {
+        cost += dist[from * (num + 1) + order[i] + 1];
+        from = order[i] + 1;
+    }
+
+    return cost;
+}
+
+/* Reorder the window tasks if that shortens paths, and empty the window */
+static void
+window_flush(void)
+{
+    static int order[WINDOW_SIZE];
+    int i, num;
+    viter iter;
+
+    window_moving = 0;
+
+    if (window == NULL || (num = vl_length(window)) == 0)
+        return;
+
+    for (i = 0; i < num; i++)
+        order[i] = i;
+
+    if (num > 2 && window_order(order, num))
+        window_moves(order, num);
+
+    v_iterate(window, iter)
+        STEP_CLEAR(STEP_ID(vl_iter_pval(iter)), S_WINDOW);
+
+    vl_empty(window);
+}
+
+/* Return whether a task can join the window, and reorder it if not */
+static int
+window_join(vhash *step, int safe)
+{
+    int i, id = STEP_ID(step), join = safe;
+    vhash *room = step_room[id];
+    vlist *list;
+    viter iter;
+
+    if (!reorder_tasks)
+        return 0;
+
+    /* It must be safe, and not change anything except the score */
+    if ((step_type[id] != T_USER && step_type[id] != T_GOTO) ||
+        room == NULL || location == NULL || vh_iget(room, "FINISH"))
+        join = 0;
+
+    for (i = 0; join && fixattr[i] != NULL; i++)
+        if (vh_exists(step, fixattr[i]))
+            join = 0;
+
+    /* It mustn't depend on other window tasks */
+    if (join && (list = vh_pget(step, "DEPEND")) != NULL) {
+        v_iterate(list, iter)
+            if (STEP_TEST(STEP_ID(vl_iter_pval(iter)), S_WINDOW))
+                join = 0;
+    }
+
+    if (!join) {
+        window_flush();
+        return 0;
+    }
+
+    if (window == NULL) {
+        window = vl_create();
+        window_visits = vl_create();
+    }
+
+    if (vl_length(window) == 0) {
+        window_start = vl_length(taskorder);
+        window_room = location;
+        vl_empty(window_visits);
+    }
+
+    window_moving = 1;
+    return 1;
+}
+
+/* Rebuild the window's movement steps for a new task order, if possible */
+static void
+window_moves(int *order, int num)
+{
+    int i, k, oldmoves = 0, newmoves = 0, ok = 1;
+    vhash *step, *reach, *room, *last;
+    vlist *route, *legs, *moves, *list;
+    viter iter, j;
+
+    /* Count the moves being replaced */
+    for (i = window_start; i < window_end; i++)
+        if (step_type[STEP_ID(vl_pget(taskorder, i))] == T_MOVE)
+            oldmoves++;
+
+    /* Find the new routes, checking that no items get left behind */
+    legs = vl_create();
+    last = window_room;
+
+    for (i = 0; ok && i < num; i++) {
+        room = step_room[STEP_ID(vl_pget(window, order[i]))];
+        if ((route = get_route(last, room)) == NULL) {
+            ok = 0;
+            break;
+        }
+
+        newmoves += vl_length(route);
+        vl_ppush(legs, vl_copy(route));
+        last = room;
+
+        v_iterate(route, iter) {
+            reach = vl_iter_pval(iter);
+            room = vh_pget(reach, "TO");
+
+            if (vh_iget(room, "FINISH"))
+                ok = 0;
+
+            for (k = 0; k < 2; k++) {
+                if ((list = vh_pget(k ? room : reach, "LEAVE")) == NULL)
+                    continue;
+
+                v_iterate(list, j)
+                    if (vh_iget(vl_iter_pval(j), "TAKEN"))
+                        ok = 0;
+            }
+        }
+    }
+
+    if (newmoves > oldmoves)
+        ok = 0;
+
+    /* Replace the window steps, noting rooms visited for the first time
+     * again */
+    if (ok) {
+        v_iterate(window_visits, iter)
+            vh_delete(vl_iter_pval(iter), "VISITED");
+
+        moves = vl_create();
+
+        for (i = 0; i < num; i++) {
+            route = vl_pget(legs, i);
+            v_iterate(route, iter)
+                vl_ppush(moves, new_move(vl_iter_pval(iter)));
+
+            step = vl_pget(window, order[i]);
+            if (step_type[STEP_ID(step)] != T_GOTO)
+                vl_ppush(moves, step);
+        }
+
+        vl_destroy(vl_splice(taskorder, window_start,
+                             window_end - window_start, moves));
+        vl_destroy(moves);
+
+        num_moves += newmoves - oldmoves;
+        solver_msg(2, "reorder tasks: %d moves instead of %d",
+                   newmoves, oldmoves);
+    }
+
+    v_iterate(legs, iter)
+        vl_destroy(vl_iter_pval(iter));
+
+    vl_destroy(legs);
+}
+
+/* Improve the order of the window tasks, and return whether it's better */
+static int
+window_order(int *order, int num)
+{
+    static int dist[(WINDOW_SIZE + 1) * (WINDOW_SIZE + 1)];
+    static int trial[WINDOW_SIZE], rest[WINDOW_SIZE];
+    int i, j, k, m, len, cost, best, start, improved;
+    vhash *from, *to;
+    vlist *route;
+    viter iter;
+
+    /* Find path lengths from the start room and each task room to each
+     * task room */
+    for (i = 0; i <= num; i++) {
+        if (i == 0)
+            from = window_room;
+        else
+            from = step_room[STEP_ID(vl_pget(window, i - 1))];
+
+        for (j = 1; j <= num; j++) {
+            to = step_room[STEP_ID(vl_pget(window, j - 1))];
+            if ((route = get_route(from, to)) == NULL) {
+                len = NO_ROUTE;
+            } else {
+                len = 0;
+                v_iterate(route, iter)
+                    len += vh_iget(vl_iter_pval(iter), "LEN");
+            }
+
+            dist[i * (num + 1) + j] = len;
+        }
+    }
+
+    /*
+     * Improve the order with 2-opt and Or-opt moves until neither helps.
+     * The last task stays last, so the solver carries on from the same
+     * place.
+     */
+    best = start = window_cost(order, num, dist);
+
+    do {
+        improved = 0;
+
+        /* Try reversing each run of tasks */
+        for (i = 0; i < num - 1; i++) {
+            for (j = i + 1; j < num - 1; j++) {
+                memcpy(trial, order, num * sizeof(int));
+                for (k = i; k <= j; k++)
+                    trial[k] = order[i + j - k];
+
+                if ((cost = window_cost(trial, num, dist)) < best) {
+                    memcpy(order, trial, num * sizeof(int));
+                    best = cost;
+                    improved = 1;
+                }
+            }
+        }
+
+        /* Try moving each run of up to three tasks elsewhere */
+        for (len = 1; len <= 3; len++) {
+            for (i = 0; i + len < num; i++) {
+                for (j = 0; j + len < num; j++) {
+                    if (j == i)
+                        continue;
+
+                    for (k = m = 0; k < num; k++)
+                        if (k < i || k >= i + len)
+                            rest[m++] = order[k];
+
+                    memcpy(trial, rest, j * sizeof(int));
+                    memcpy(trial + j, order + i, len * sizeof(int));
+                    memcpy(trial + j + len, rest + j,
+                           (num - len - j) * sizeof(int));
+
+                    if ((cost = window_cost(trial, num, dist)) < best) {
+                        memcpy(order, trial, num * sizeof(int));
+                        best = cost;
+                        improved = 1;
+                    }
+                }
+            }
+        }
+    } while (improved);
+
+    return (best < start);
+}
@@ -19,15 +19,48 @@ enum {
     T_MOVE, T_GET, T_DROP, T_GOTO, T_USER
 };
 
+/* Task step flags */
+#define S_LISTED        0x01    /* In the task list */
+#define S_DONE          0x02    /* Done, or found to be redundant */
+#define S_OPTIONAL      0x04    /* Needn't be done */
+#define S_IGNORED       0x08    /* Ignored by the solver */
+#define S_BLOCK         0x10    /* Path to it may be blocked */
+#define S_READY         0x20    /* In the ready list */
+#define S_FILTER        0x40    /* Waiting for a redundancy check */
+#define S_WINDOW        0x80    /* In the window of tasks to reorder */
+
+/* Task step table entry for a step */
+#define STEP_ID(step)           step_id(step)
+
+/* Test, set and clear task step flags */
+#define STEP_TEST(id, flag)     (step_flags[id] & (flag))
+#define STEP_SET(id, flag)      (step_flags[id] |= (flag))
+#define STEP_CLEAR(id, flag)    (step_flags[id] &= ~(flag))
+
+/* Task step table (solver fields, indexed by step ID) */
+extern int *step_type;
+extern int *step_flags;
+extern int *step_sort;
+extern int *step_dist;
+extern int *step_order;
+extern int *step_wait;
+extern vhash **step_room;
+
 /* Task list */
 extern vlist *tasklist;
 
+/* Inventory and done-task bit sets */
+extern unsigned long *taken_items;
+extern unsigned long *done_tasks;
+
 /* Advertised functions */
 extern void check_cycles(void);
 extern vhash *require_task(vhash *step);
 extern void setup_tasks(void);
 extern void solve_game(void);
 extern void solver_msg(int level, char *fmt, ...);
+extern int step_id(vhash *step);
+extern void task_counts(vhash *stats);
 extern vgraph *task_graph(void);
 
 #endif
@@ -87,6 +87,39 @@ add_list(vhash *obj, char *attr, vhash *thing)
     vl_ppush(list, thing);
 }
 
+/* Return whether two bit sets have any bits in common */
+int
+bits_common(unsigned long *b1, unsigned long *b2, int size)
+{
+    int i, num = BITS_LEN(size);
+
+    for (i = 0; i < num; i++)
+        if (b1[i] & b2[i])
+            return 1;
+
+    return 0;
+}
+
+/* Create a bit set of a given size, with all bits clear */
+unsigned long *
+bits_create(int size)
+{
+    return V_CALLOC(unsigned long, V_MAX(BITS_LEN(size), 1));
+}
+
+/* Return whether all bits of the first set are in the second */
+int
+bits_subset(unsigned long *b1, unsigned long *b2, int size)
+{
+    int i, num = BITS_LEN(size);
+
+    for (i = 0; i < num; i++)
+        if (b1[i] & ~b2[i])
+            return 0;
+
+    return 1;
+}
+
 /* Locate a file using the search path */
 char *
 find_file(char *name)
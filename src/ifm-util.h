@@ -26,9 +26,20 @@ enum {
 
 extern struct d_info dirinfo[];
 
+/* Bit set stuff */
+#define BITS_WORD       (8 * sizeof(unsigned long))
+#define BITS_LEN(size)  (((size) + BITS_WORD - 1) / BITS_WORD)
+
+#define BIT_SET(b, n)   ((b)[(n) / BITS_WORD] |= 1UL << ((n) % BITS_WORD))
+#define BIT_CLEAR(b, n) ((b)[(n) / BITS_WORD] &= ~(1UL << ((n) % BITS_WORD)))
+#define BIT_TEST(b, n)  (((b)[(n) / BITS_WORD] >> ((n) % BITS_WORD)) & 1)
+
 /* Advertised functions */
 extern void add_attr(vhash *obj, char *attr, char *fmt, ...);
 extern void add_list(vhash *obj, char *attr, vhash *thing);
+extern int bits_common(unsigned long *b1, unsigned long *b2, int size);
+extern unsigned long *bits_create(int size);
+extern int bits_subset(unsigned long *b1, unsigned long *b2, int size);
 extern char *find_file(char *name);
 extern int get_direction(int xoff, int yoff);
 extern int get_papersize(char *pagesize, float *width, float *height);
@@ -57,6 +57,56 @@
   function calls.
 */
 
+/*!
+  @defgroup graph_index Integer-indexed access
+  @ingroup graph
+
+  A graph can be 'compiled' into a compact form in which each node and
+  each link has a dense integer index, and the links to and from each node
+  are held in contiguous arrays.  The compiled form is built automatically
+  the first time it is needed, and is discarded whenever nodes or links are
+  added or deleted (changing the value of a node or link doesn't affect
+  it).
+
+  The functions in this group take and return these indices instead of
+  node names, and avoid the string lookups needed by the name-based
+  functions.  Indices are only valid until the graph structure next
+  changes.
+
+  If the connection functions change their minds about only a few links
+  or nodes, the path cache needn't be rebuilt from scratch.  Instead,
+  flag each change with vg_link_changed() or vg_node_changed() and then
+  call vg_ipath_repair().
+*/
+
+/*!
+  @defgroup graph_search Reentrant path searches
+  @ingroup graph
+
+  The path functions keep their search state in the graph itself (and
+  in a few file-level counters), so only one search can be done at a
+  time.  A search context has its own copy of that state, so several
+  contexts can search the same graph at once (in different threads,
+  say).  Searches in a context don't use or update the path cache, but
+  are directed by landmarks if vg_use_landmarks() is in effect.
+
+  A context is created by vg_search_begin() and destroyed by
+  vg_search_end().  Creating a context compiles the graph and finds
+  landmark path lengths if that hasn't been done already, and destroying
+  one adds its search counts to the graph's, so contexts must be created
+  one at a time, before any of them start searching, and destroyed once
+  they have all finished.  In between, searches in a context only read
+  the graph.  The graph mustn't be changed, and the other path functions
+  mustn't be called on it, while contexts are in use, and the connection
+  functions must be safe to call concurrently.  Node indices are the
+  same as for the integer-indexed functions.
+
+  vg_search_nodes() and vg_search_info() return new lists.  The list
+  type is set up when the first context is created, so this is safe to
+  do from several threads, as long as memory debugging (see v_debug())
+  is off.
+*/
+
 /*!
   @defgroup graph_sort Topological sorting
   @ingroup graph
@@ -104,16 +154,32 @@
         n = vh_pget((g)->nodemap, node)
 
 #define FINDLINK(g, n1, n2, l)                                          \
-        sprintf(findbuf, "%d|%d", (n1)->id, (n2)->id);                  \
-        l = vh_pget((g)->linkmap, findbuf)
+        l = vg_findlink(g, n1, n2)
+
+#define LINKNAME(buf, n1, n2)                                           \
+        sprintf(buf, "%d|%d", (n1)->id, (n2)->id)
+
+#define COMPILE(g)                                                      \
+        if (!(g)->compiled) vg_compile(g)
+
+#define UNCOMPILE(g)                                                    \
+        (g)->compiled = 0
+
+#define NODE_OK(g, i)                                                   \
+        ((i) >= 0 && (i) < (int) (g)->nodes)
+
+#define LINK_OK(g, i)                                                   \
+        ((i) >= 0 && (i) < (int) (g)->links)
 
 #define USENODE(g, n, dist)                                             \
-        ((g)->use_node == NULL || (*g->use_node)((n)->name,             \
+        ((g)->use_inode != NULL ? (*g->use_inode)((n)->index, dist) :   \
+         (g)->use_node == NULL || (*g->use_node)((n)->name,             \
                                                  (n)->val,              \
                                                  dist))
 
 #define USELINK(g, l)                                                   \
-        ((g)->use_link == NULL || (*g->use_link)((l)->from->name,       \
+        ((g)->use_ilink != NULL ? (*g->use_ilink)((l)->index) :         \
+         (g)->use_link == NULL || (*g->use_link)((l)->from->name,       \
                                                  (l)->to->name,         \
                                                  (l)->val))
 
@@ -160,8 +226,33 @@
 #define NOCACHE                                                         \
         cache_flag = 0
 
+#define PATHDIST(n)                                                     \
+        (cache_flag ? (n)->cache->cachedist : (n)->path->dist)
+
+#define CACHED(g, n)                                                    \
+        ((n) == (g)->cache ||                                           \
+         ((n)->cachevisit == cachecount && (n)->cache != NULL))
+
+#define CACHEDIST(g, n)                                                 \
+        ((n) == (g)->cache ? 0.0 : (n)->cache->cachedist)
+
+#define SVISITED(s, n)                                                  \
+        ((s)->visit[n] == (s)->stamp)
+
+#define SSEEN(s, n)                                                     \
+        ((s)->seen[n] == (s)->stamp)
+
+#define IWORD (8 * sizeof(unsigned long))
+
+#define IREACHES(g, c1, c2)                                             \
+        (((g)->ireach[(c1) * (g)->iwords + (c2) / IWORD]                \
+          >> ((c2) % IWORD)) & 1)
+
 #define NOPATH -999
 
+/* Max links to scan when finding a link in compiled form */
+#define SCANMAX 16
+
 /* Type definition */
 struct v_graph {
     struct v_header id;         /* Type marker */
@@ -188,17 +279,69 @@ struct v_graph {
     /* Search functions */
     int (*use_node)(char *node, vscalar *s, double dist);
     int (*use_link)(char *node1, char *node2, vscalar *s);
+    int (*use_inode)(int node, double dist);
+    int (*use_ilink)(int link);
     double (*link_size)(char *node1, char *node2, vscalar *s);
 
     /* Cache information */
     struct v_node *cache;       /* Cache node */
     int use_cache;              /* Whether to use cache */
+    int repaired;               /* Whether cache has been repaired */
+    struct v_list *nchanged;    /* Changed node indices */
+    struct v_list *lchanged;    /* Changed link indices */
+
+    /* Cache information for other nodes */
+    struct v_pcache *pcache;    /* Cached paths */
+    int pcachesize;             /* Max. no. of nodes to cache */
+    int pcachecount;            /* No. of nodes cached */
+    int generation;             /* Cache generation */
+    int clock;                  /* Cache usage clock */
+    int hits;                   /* No. of cache hits */
+    int misses;                 /* No. of cache misses */
+
+    /* Search statistics */
+    long expanded;              /* No. of nodes expanded */
+    long relaxed;               /* No. of links queued */
+
+    /* Cache information for paths to a node */
+    struct v_node *rcache;      /* Node paths go to */
+    int rgeneration;            /* Cache generation when found */
+    double *rdist;              /* Node index -> path length */
+    int *rlink;                 /* Node index -> first link index of path */
+
+    /* Landmark information */
+    int landmarks;              /* Max. no. of landmark nodes */
+    int lmcount;                /* No. of landmark nodes chosen */
+    double *lmdist;             /* Path lengths from and to each landmark */
+
+    /* Search context for uncached paths */
+    struct v_search *search;
+
+    /* Reachability index */
+    int icount;                 /* No. of components (or -1 if none) */
+    int igeneration;            /* Cache generation when built */
+    int iwords;                 /* Words in each component bit set */
+    int *icomp;                 /* Node index -> component (or -1) */
+    int *ilink;                 /* Link index -> whether usable */
+    unsigned long *ireach;      /* Component -> components it can reach */
+
+    /* Compiled form */
+    int compiled;               /* Whether compiled form is up to date */
+    struct v_node **nodevec;    /* Node index -> node */
+    struct v_link **linkvec;    /* Link index -> link */
+    int *tstart;                /* Node index -> start of its 'to' links */
+    int *tlinks;                /* Link indices of 'to' links */
+    int *tnodes;                /* Node indices they link to */
+    int *fstart;                /* Node index -> start of its 'from' links */
+    int *flinks;                /* Link indices of 'from' links */
+    int *fnodes;                /* Node indices they link from */
 };
 
 struct v_node {
     char *name;                 /* Node name */
     struct v_scalar *val;       /* Node value */
     int id;                     /* Node ID */
+    int index;                  /* Compiled node index */
     int pnum;                   /* Print number */
 
     /* Links */
@@ -228,6 +371,7 @@ struct v_link {
     struct v_scalar *val;       /* Link value */
     struct v_node *from;        /* Node linked from */
     struct v_node *to;          /* Node linked to */
+    int index;                  /* Compiled link index */
 
     /* Links */
     struct v_link *lprev;       /* Previous link in graph list */
@@ -246,9 +390,32 @@ struct v_link {
     int opposite;               /* Whether link has an opposite */
 };
 
+struct v_search {
+    struct v_graph *g;          /* Graph being searched */
+    struct v_queue *queue;      /* Queue of links to follow */
+    int stamp;                  /* Current search stamp */
+    int *visit;                 /* Node index -> stamp when visited */
+    int *seen;                  /* Node index -> stamp when first reached */
+    int *path;                  /* Node index -> last link index of path */
+    double *dist;               /* Link index -> distance from start node */
+    struct v_list *nodes;       /* Nodes waiting to be looked at */
+    long expanded;              /* No. of nodes expanded */
+    long relaxed;               /* No. of links queued */
+};
+
+/* Paths cached from a node other than the cache node */
+struct v_pcache {
+    int node;                   /* Node index paths start from */
+    int generation;             /* Cache generation when found */
+    int used;                   /* When last used */
+    double *dist;               /* Node index -> path length */
+    int *link;                  /* Node index -> last link index of path */
+};
+
 /* Internal type abbreviations */
 typedef struct v_node vnode;
 typedef struct v_link vlink;
+typedef struct v_pcache vpcache;
 
 /* Search types */
 enum {
@@ -270,20 +437,39 @@ static int caching_now = 0;
 /* Topological sort data */
 static vlist *tsort_cycles = NULL;
 
-/* Find-link buffer */
-static char findbuf[20];
-
 /* Internal functions */
+static vlist *vg_build_ipath(vgraph *g, vnode *n);
 static vlist *vg_build_path(vgraph *g, vnode *n);
+static double vg_cache(vgraph *g, vnode *n);
 static void vg_delete_link(vgraph *g, vlink *l);
 static void vg_delete_node(vgraph *g, vnode *n);
+static vlink *vg_findlink(vgraph *g, vnode *n1, vnode *n2);
 static vlink *vg_getlink(vgraph *g, char *node1, char *node2);
 static vnode *vg_getnode(vgraph *g, char *node);
 static void vg_getusage(vgraph *g);
+static void vg_index(vgraph *g);
+static double vg_landmark_bound(vgraph *g, int node, int to);
+static void vg_landmark_search(vsearch *s, vnode *n, double *dist, int rev);
+static void vg_landmarks(vgraph *g, vsearch *s);
+static double vg_length(vgraph *g, vnode *n1, vnode *n2);
 static double vg_link_size(vgraph *g, vlink *l);
-static vlink *vg_newlink(vgraph *g, vnode *n1, vnode *n2, char *map);
+static vlink *vg_newlink(vgraph *g, vnode *n1, vnode *n2);
 static vnode *vg_newnode(vgraph *g, char *node);
-static void vg_tsort_visit(vgraph *g, vnode *n, vlist *order);
+static vnode *vg_path_lookup(vgraph *g, vnode *n1, vnode *n2, int route);
+static vnode *vg_path_rlookup(vgraph *g, vnode *n1, vnode *n2);
+static vnode *vg_path_visit(vgraph *g, vnode *n1, vnode *n2, int route);
+static void vg_pcache_free(vgraph *g);
+static double vg_rcache(vgraph *g, vnode *n);
+static int vg_reaches(vgraph *g, int node1, int node2);
+static int vg_search_astar(vsearch *s, int from, int to);
+static vsearch *vg_search_context(vgraph *g);
+static vnode *vg_search_copy(vsearch *s, vnode *n1, int end, int route);
+static vsearch *vg_search_create(vgraph *g);
+static vsearch *vg_search_prepare(vgraph *g);
+static int vg_search_priority(vsearch *s, int from, int to);
+static int vg_search_visit(vsearch *s, int from, int to);
+static vlist *vg_tsort_cycle(vgraph *g, int root, int *icomp, int *queue);
+static void vg_uncompile(vgraph *g);
 static vnode *vg_visit(vgraph *g, vnode *from, vnode *to, int type,
                        vlist *visit);
 static int vg_xmldump(vgraph *g, FILE *fp);
@@ -313,6 +499,121 @@ vg_build_path(vgraph *g, vnode *n)
     return path;
 }
 
+/* Build a path of node indices given a start node */
+static vlist *
+vg_build_ipath(vgraph *g, vnode *n)
+{
+    vnode *start = n;
+    vlist *path;
+
+    path = vl_create();
+    vl_iunshift(path, n->index);
+
+    while (HASPATH(n)) {
+        if (cache_flag)
+            n = n->cache->from;
+        else
+            n = n->path->from;
+
+        if (n == start)
+            break;
+
+        vl_iunshift(path, n->index);
+    }
+
+    return path;
+}
+
+/* Cache paths from a given node (or turn caching off) */
+static double
+vg_cache(vgraph *g, vnode *n)
+{
+    /* Forget any repairs */
+    g->repaired = 0;
+    if (g->nchanged != NULL)
+        vl_empty(g->nchanged);
+    if (g->lchanged != NULL)
+        vl_empty(g->lchanged);
+
+    if (n != NULL) {
+        g->cache = n;
+        g->use_cache = 1;
+        cache_flag = 1;
+
+        INIT_VISIT;
+        caching_now = 1;
+        n = vg_visit(g, n, NULL, V_PRIORITY, NULL);
+        caching_now = 0;
+
+        if (n == NULL || n->path == NULL)
+            return 0;
+
+        return n->path->dist;
+    }
+
+    g->cache = NULL;
+    g->use_cache = 0;
+
+    return NOPATH;
+}
+
+/*!
+  @brief   Forget cached paths from nodes other than the cache node.
+  @ingroup graph_connect
+  @param   g Graph.
+  @see     vg_cache_size()
+
+  This should be called whenever the user-defined connection functions
+  might give different answers for some nodes or links.  It doesn't
+  affect paths cached by vg_path_cache().
+*/
+void
+vg_cache_flush(vgraph *g)
+{
+    VG_CHECK(g);
+    g->generation++;
+}
+
+/*!
+  @brief   Return path cache usage counts.
+  @ingroup graph_connect
+  @param   g Graph.
+  @param[out] hits No. of path searches answered from the cache.
+  @param[out] misses No. of path searches that had to visit nodes.
+
+  Only searches done while the cache is in use are counted.
+*/
+void
+vg_cache_info(vgraph *g, int *hits, int *misses)
+{
+    VG_CHECK(g);
+    *hits = g->hits;
+    *misses = g->misses;
+}
+
+/*!
+  @brief   Set no. of other nodes to cache paths from.
+  @ingroup graph_connect
+  @param   g Graph.
+  @param   size Max. no. of nodes.
+
+  As well as the node given to vg_path_cache(), paths can be cached from
+  up to this many other nodes (the default is zero).  When the cache is in
+  use, a path search from one of these nodes finds paths to all other
+  nodes at once and caches them, and later searches from the same node
+  are looked up.  If the cache is full, the least recently used node is
+  replaced.  The cached paths are the same as a direct search would
+  find, so long as vg_cache_flush() is called whenever the connection
+  functions change their minds.
+*/
+void
+vg_cache_size(vgraph *g, int size)
+{
+    VG_CHECK(g);
+    vg_pcache_free(g);
+    g->pcachesize = V_MAX(size, 0);
+}
+
 /*!
   @brief   Return whether currently updating path cache.
   @ingroup graph_connect
@@ -333,6 +634,75 @@ vg_check(void *ptr)
     return (ptr != NULL && v_type(ptr) == vgraph_type);
 }
 
+/*!
+  @brief   Build the compiled form of a graph.
+  @ingroup graph_index
+  @param   g Graph.
+
+  Assign each node and link an integer index, and build the arrays of
+  links to and from each node.  Nodes are indexed in order of creation,
+  and the links of each node keep the order they were added in.  This
+  does nothing if the compiled form is already up to date.
+*/
+void
+vg_compile(vgraph *g)
+{
+    int num, tpos, fpos;
+    vnode *n;
+    vlink *l;
+
+    VG_CHECK(g);
+
+    if (g->compiled)
+        return;
+
+    vg_uncompile(g);
+
+    g->nodevec = V_ALLOC(vnode *, g->nodes + 1);
+    g->linkvec = V_ALLOC(vlink *, g->links + 1);
+    g->tstart = V_ALLOC(int, g->nodes + 1);
+    g->tlinks = V_ALLOC(int, g->links + 1);
+    g->tnodes = V_ALLOC(int, g->links + 1);
+    g->fstart = V_ALLOC(int, g->nodes + 1);
+    g->flinks = V_ALLOC(int, g->links + 1);
+    g->fnodes = V_ALLOC(int, g->links + 1);
+
+    /* Index nodes and links */
+    num = 0;
+    for (n = g->nhead; n != NULL; n = n->nnext) {
+        n->index = num;
+        g->nodevec[num++] = n;
+    }
+
+    num = 0;
+    for (l = g->lhead; l != NULL; l = l->lnext) {
+        l->index = num;
+        g->linkvec[num++] = l;
+    }
+
+    /* Build per-node link arrays */
+    tpos = fpos = 0;
+    for (num = 0; num < (int) g->nodes; num++) {
+        n = g->nodevec[num];
+
+        g->tstart[num] = tpos;
+        for (l = n->thead; l != NULL; l = l->tnext) {
+            g->tlinks[tpos] = l->index;
+            g->tnodes[tpos++] = l->to->index;
+        }
+
+        g->fstart[num] = fpos;
+        for (l = n->fhead; l != NULL; l = l->fnext) {
+            g->flinks[fpos] = l->index;
+            g->fnodes[fpos++] = l->from->index;
+        }
+    }
+
+    g->tstart[g->nodes] = tpos;
+    g->fstart[g->nodes] = fpos;
+    g->compiled = 1;
+}
+
 /*!
   @brief   Return list of connected groups of nodes.
   @ingroup graph_connect
@@ -438,10 +808,44 @@ vg_create(void)
 
     g->use_node = NULL;
     g->use_link = NULL;
+    g->use_inode = NULL;
+    g->use_ilink = NULL;
     g->link_size = NULL;
 
     g->cache = NULL;
     g->use_cache = 0;
+    g->repaired = 0;
+    g->nchanged = NULL;
+    g->lchanged = NULL;
+
+    g->pcache = NULL;
+    g->pcachesize = g->pcachecount = 0;
+    g->generation = g->clock = 0;
+    g->hits = g->misses = 0;
+    g->expanded = g->relaxed = 0;
+
+    g->rcache = NULL;
+    g->rgeneration = 0;
+    g->rdist = NULL;
+    g->rlink = NULL;
+
+    g->landmarks = g->lmcount = 0;
+    g->lmdist = NULL;
+
+    g->search = NULL;
+
+    g->icount = -1;
+    g->igeneration = 0;
+    g->iwords = 0;
+    g->icomp = NULL;
+    g->ilink = NULL;
+    g->ireach = NULL;
+
+    g->compiled = 0;
+    g->nodevec = NULL;
+    g->linkvec = NULL;
+    g->tstart = g->tlinks = g->tnodes = NULL;
+    g->fstart = g->flinks = g->fnodes = NULL;
 
     return g;
 }
@@ -501,6 +905,7 @@ vg_delete_link(vgraph *g, vlink *l)
         vs_destroy(l->val);
 
     /* Destroy it */
+    UNCOMPILE(g);
     g->links--;
     V_DEALLOC(l);
 }
@@ -530,6 +935,7 @@ vg_delete_node(vgraph *g, vnode *n)
         vs_destroy(n->val);
 
     /* Destroy it */
+    UNCOMPILE(g);
     g->nodes--;
     V_DEALLOC(n->name);
     V_DEALLOC(n);
@@ -557,10 +963,45 @@ vg_destroy(vgraph *g)
     vh_destroy(g->nodemap);
     vh_destroy(g->linkmap);
 
+    /* Destroy compiled form */
+    vg_uncompile(g);
+
+    /* Destroy change lists */
+    if (g->nchanged != NULL)
+        vl_destroy(g->nchanged);
+    if (g->lchanged != NULL)
+        vl_destroy(g->lchanged);
+
     /* Destroy it */
     V_DEALLOC(g);
 }
 
+/* Find a link given its two nodes */
+static vlink *
+vg_findlink(vgraph *g, vnode *n1, vnode *n2)
+{
+    char buf[30];
+    int k, end;
+
+    /* Scan the 'to' links if not too many of them */
+    if (g->compiled) {
+        k = g->tstart[n1->index];
+        end = g->tstart[n1->index + 1];
+
+        if (end - k <= SCANMAX) {
+            for (; k < end; k++)
+                if (g->tnodes[k] == n2->index)
+                    return g->linkvec[g->tlinks[k]];
+
+            return NULL;
+        }
+    }
+
+    /* Otherwise, look it up */
+    LINKNAME(buf, n1, n2);
+    return vh_pget(g->linkmap, buf);
+}
+
 /* Freeze contents of a graph */
 int
 vg_freeze(vgraph *g, FILE *fp)
@@ -654,7 +1095,7 @@ vg_getlink(vgraph *g, char *node1, char *node2)
 
     FINDLINK(g, n1, n2, l);
     if (l == NULL)
-        l = vg_newlink(g, n1, n2, findbuf);
+        l = vg_newlink(g, n1, n2);
 
     return l;
 }
@@ -672,6 +1113,151 @@ vg_getnode(vgraph *g, char *node)
     return n;
 }
 
+/* Build the reachability index */
+static void
+vg_index(vgraph *g)
+{
+    int i, j, k, n, m, c, top, sp, end, count, nodes = g->nodes;
+    int *num, *low, *iter, *calls, *stack, *order, *first;
+    unsigned long *r1, *r2;
+    int *usable;
+
+    V_DEALLOC(g->icomp);
+    V_DEALLOC(g->ilink);
+    V_DEALLOC(g->ireach);
+
+    g->icomp = V_ALLOC(int, nodes + 1);
+    g->ilink = V_ALLOC(int, g->links + 1);
+    g->igeneration = g->generation;
+
+    /* Find which nodes and links can be used */
+    usable = V_ALLOC(int, nodes + 1);
+    for (i = 0; i < nodes; i++)
+        usable[i] = USENODE(g, g->nodevec[i], 0.0);
+
+    for (i = 0; i < (int) g->links; i++)
+        g->ilink[i] = USELINK(g, g->linkvec[i]);
+
+    /*
+     * Find strongly connected components of the usable nodes (Tarjan's
+     * algorithm, without recursion).  Components are numbered in reverse
+     * topological order, so links between components always go to a
+     * lower-numbered one.
+     */
+    num = V_ALLOC(int, nodes + 1);
+    low = V_ALLOC(int, nodes + 1);
+    iter = V_ALLOC(int, nodes + 1);
+    calls = V_ALLOC(int, nodes + 1);
+    stack = V_ALLOC(int, nodes + 1);
+
+    for (i = 0; i < nodes; i++) {
+        num[i] = -1;
+        g->icomp[i] = -1;
+    }
+
+    count = c = sp = 0;
+
+    for (i = 0; i < nodes; i++) {
+        if (!usable[i] || num[i] >= 0)
+            continue;
+
+        top = 0;
+        calls[0] = i;
+        iter[i] = g->tstart[i];
+        num[i] = low[i] = count++;
+        stack[sp++] = i;
+
+        while (top >= 0) {
+            n = calls[top];
+
+            if (iter[n] < g->tstart[n + 1]) {
+                /* Follow next usable link */
+                k = iter[n]++;
+                m = g->tnodes[k];
+                if (!g->ilink[g->tlinks[k]] || !usable[m])
+                    continue;
+
+                if (num[m] < 0) {
+                    calls[++top] = m;
+                    iter[m] = g->tstart[m];
+                    num[m] = low[m] = count++;
+                    stack[sp++] = m;
+                } else if (g->icomp[m] < 0) {
+                    low[n] = V_MIN(low[n], num[m]);
+                }
+            } else {
+                /* All links done -- pop component if it's the root */
+                if (low[n] == num[n]) {
+                    do {
+                        m = stack[--sp];
+                        g->icomp[m] = c;
+                    } while (m != n);
+                    c++;
+                }
+
+                if (--top >= 0) {
+                    m = calls[top];
+                    low[m] = V_MIN(low[m], low[n]);
+                }
+            }
+        }
+    }
+
+    /* Sort nodes by component */
+    first = V_CALLOC(int, c + 1);
+    order = stack;
+
+    for (i = 0; i < nodes; i++)
+        if (g->icomp[i] >= 0)
+            first[g->icomp[i] + 1]++;
+
+    for (j = 0; j < c; j++)
+        first[j + 1] += first[j];
+
+    for (i = 0; i < nodes; i++)
+        if (g->icomp[i] >= 0)
+            order[first[g->icomp[i]]++] = i;
+
+    for (j = c; j > 0; j--)
+        first[j] = first[j - 1];
+    first[0] = 0;
+
+    /* Find components reachable from each, lowest-numbered first */
+    g->icount = c;
+    g->iwords = (c + IWORD - 1) / IWORD;
+    g->ireach = V_CALLOC(unsigned long, c * g->iwords + 1);
+
+    for (j = 0; j < c; j++) {
+        r1 = g->ireach + j * g->iwords;
+        r1[j / IWORD] |= 1UL << (j % IWORD);
+
+        for (i = first[j]; i < first[j + 1]; i++) {
+            n = order[i];
+            end = g->tstart[n + 1];
+            for (k = g->tstart[n]; k < end; k++) {
+                if (!g->ilink[g->tlinks[k]])
+                    continue;
+
+                m = g->icomp[g->tnodes[k]];
+                if (m < 0 || m == j || IREACHES(g, j, m))
+                    continue;
+
+                r2 = g->ireach + m * g->iwords;
+                for (sp = 0; sp < g->iwords; sp++)
+                    r1[sp] |= r2[sp];
+            }
+        }
+    }
+
+    V_DEALLOC(usable);
+    V_DEALLOC(num);
+    V_DEALLOC(low);
+    V_DEALLOC(iter);
+    V_DEALLOC(calls);
+    V_DEALLOC(stack);
+    V_DEALLOC(first);
+}
+
 /* Get usage information for graph's nodes and links */
 static void
 vg_getusage(vgraph *g)
@@ -702,752 +1288,2123 @@ vg_getusage(vgraph *g)
 }
 
 /*!
-  @brief   Return number of links in a graph.
-  @ingroup graph_access
+  @brief   Cache paths from a given node index.
+  @ingroup graph_index
   @param   g Graph.
-  @return  No. of links.
+  @param   node Node index to cache from, or -1.
+  @return  Distance of furthest reachable node.
+  @see     vg_path_cache()
 */
-int
-vg_link_count(vgraph *g)
+double
+vg_ipath_cache(vgraph *g, int node)
 {
     VG_CHECK(g);
-    return g->links;
+    COMPILE(g);
+
+    return vg_cache(g, NODE_OK(g, node) ? g->nodevec[node] : NULL);
 }
 
 /*!
-  @brief   Return whether a link exists.
-  @ingroup graph_access
+  @brief   Return list of info about path twixt two node indices.
+  @ingroup graph_index
   @param   g Graph.
-  @param   node1 From node.
-  @param   node2 To node.
-  @return  Yes or no.
+  @param   node1 From node index.
+  @param   node2 To node index.
+  @return  List of path length followed by node indices.
+  @retval  @c NULL if a path doesn't exist.
+  @see     vg_path_info()
 */
-int
-vg_link_exists(vgraph *g, char *node1, char *node2)
+vlist *
+vg_ipath_info(vgraph *g, int node1, int node2)
 {
-    vnode *n1, *n2;
-    vlink *l;
+    vlist *path;
+    vnode *n;
 
     VG_CHECK(g);
+    COMPILE(g);
 
-    FINDNODE(g, node1, n1);
-    FINDNODE(g, node2, n2);
-    if (n1 == NULL || n2 == NULL)
-        return 0;
+    if (!NODE_OK(g, node1) || !NODE_OK(g, node2))
+        return NULL;
 
-    FINDLINK(g, n1, n2, l);
+    if (node1 == node2) {
+        path = vl_create();
+        vl_ipush(path, node1);
+        vl_dunshift(path, 0.0);
+    } else if ((n = vg_path_visit(g, g->nodevec[node1],
+                                  g->nodevec[node2], 1)) != NULL) {
+        path = vg_build_ipath(g, n);
+        vl_dunshift(path, PATHDIST(n));
+    } else {
+        path = NULL;
+    }
 
-    return (l != NULL);
+    return path;
 }
 
 /*!
-  @brief   Return data associated with a link.
-  @ingroup graph_access
+  @brief   Return length of a path between two node indices.
+  @ingroup graph_index
   @param   g Graph.
-  @param   node1 From node.
-  @param   node2 To node.
-  @return  Value.
-  @retval  NULL if the link doesn't exist.
+  @param   node1 From node index.
+  @param   node2 To node index.
+  @return  Path length.
+  @retval  Negative if there's no path.
+  @see     vg_path_length()
 */
-vscalar *
-vg_link_get(vgraph *g, char *node1, char *node2)
+double
+vg_ipath_length(vgraph *g, int node1, int node2)
 {
-    vnode *n1, *n2;
-    vlink *l;
+    VG_CHECK(g);
+    COMPILE(g);
+
+    if (!NODE_OK(g, node1) || !NODE_OK(g, node2))
+        return NOPATH;
+
+    return vg_length(g, g->nodevec[node1], g->nodevec[node2]);
+}
+
+/*!
+  @brief   Return list of node indices twixt two node indices.
+  @ingroup graph_index
+  @param   g Graph.
+  @param   node1 From node index.
+  @param   node2 To node index.
+  @return  List of node indices.
+  @retval  @c NULL if a path doesn't exist.
+  @see     vg_path_nodes()
+*/
+vlist *
+vg_ipath_nodes(vgraph *g, int node1, int node2)
+{
+    vlist *path;
+    vnode *n;
 
     VG_CHECK(g);
+    COMPILE(g);
 
-    FINDNODE(g, node1, n1);
-    FINDNODE(g, node2, n2);
-    if (n1 == NULL || n2 == NULL)
+    if (!NODE_OK(g, node1) || !NODE_OK(g, node2))
         return NULL;
 
-    FINDLINK(g, n1, n2, l);
+    if (node1 == node2) {
+        path = vl_create();
+        vl_ipush(path, node1);
+    } else if ((n = vg_path_visit(g, g->nodevec[node1],
+                                  g->nodevec[node2], 1)) != NULL) {
+        path = vg_build_ipath(g, n);
+    } else {
+        path = NULL;
+    }
 
-    return (l == NULL ? NULL : l->val);
+    return path;
 }
 
 /*!
-  @brief   Declare a one-way link and associate data with it.
-  @ingroup graph_modify
+  @brief   Cache paths to a given node index.
+  @ingroup graph_index
   @param   g Graph.
-  @param   node1 From node.
-  @param   node2 To node.
-  @param   s Value to store (or @c NULL).
-
-  Firstly, if any of the named nodes don't exist, create them (with
-  undefined scalar values).  Then, if a link between the nodes doesn't
-  exist, create it.  Finally, replace its current scalar value (if any)
-  with the given value.
+  @param   node Node index to cache paths to, or -1.
+  @return  Distance of furthest node that can reach it.
+  @see     vg_path_rcache()
 */
-void
-vg_link_oneway_store(vgraph *g, char *node1, char *node2, vscalar *s)
+double
+vg_ipath_rcache(vgraph *g, int node)
 {
-    vlink *l;
-
     VG_CHECK(g);
+    COMPILE(g);
 
-    l = vg_getlink(g, node1, node2);
-    if (l->val != NULL)
-        vs_destroy(l->val);
-    l->val = s;
-}
-
-/* Return the size of a link */
-static double
-vg_link_size(vgraph *g, vlink *l)
-{
-    double size;
-
-    if (g->link_size != NULL) {
-        size = (*g->link_size)(l->from->name, l->to->name, l->val);
-    } else {
-        switch (vs_type(l->val)) {
-        case V_TYPE_INT:
-        case V_TYPE_FLOAT:
-        case V_TYPE_DOUBLE:
-            size = vs_dget(l->val);
-            break;
-        default:
-            size = 1.0;
-            break;
-        }
-    }
-
-    return (size >= 0.0 ? size : 0.0);
+    return vg_rcache(g, NODE_OK(g, node) ? g->nodevec[node] : NULL);
 }
 
 /*!
-  @brief   Set the link-size function of a graph.
-  @ingroup graph_connect
+  @brief   Return whether there's a path between two node indices.
+  @ingroup graph_index
   @param   g Graph.
-  @param   func Function to calculate link size.
+  @param   node1 From node index.
+  @param   node2 To node index.
+  @return  Yes or no.
+  @see     vg_path_exists()
+
+  Like vg_path_exists(), but answered from an index of which groups of
+  nodes can reach each other.  The strongly connected components of the
+  usable part of the graph are found, and which components can reach
+  which others.  Each later query only compares two components.  The
+  index is rebuilt the next time it's needed after vg_cache_flush() is
+  called, so it has the same validity as the path cache.
 */
-void
-vg_link_size_function(vgraph *g, double (*func)(char *node1, char *node2,
-                                                vscalar *s))
+int
+vg_ipath_reachable(vgraph *g, int node1, int node2)
 {
     VG_CHECK(g);
-    g->link_size = func;
+    COMPILE(g);
+
+    if (!NODE_OK(g, node1) || !NODE_OK(g, node2))
+        return 0;
+
+    if (node1 == node2)
+        return 1;
+
+    if (g->icount < 0 || g->igeneration != g->generation)
+        vg_index(g);
+
+    return vg_reaches(g, node1, node2);
 }
 
 /*!
-  @brief   Declare a two-way link and associate the same data with both.
-  @ingroup graph_modify
+  @brief   Repair the path cache after changes in link or node usage.
+  @ingroup graph_index
   @param   g Graph.
-  @param   node1 From node.
-  @param   node2 To node.
-  @param   s Value to set.
+  @return  Distance of furthest reachable node.
+  @retval  Negative if there's no path cache.
+  @see     vg_link_changed(), vg_node_changed()
+
+  Only the part of the cached shortest-path tree that passes through the
+  changed links and nodes is searched again, together with any nodes
+  whose paths get shorter.  Path lengths are the same as those of a full
+  vg_ipath_cache().  Equal-length paths might be chosen differently,
+  though, so paths out of a repaired cache are found by a fresh search
+  until the cache is next rebuilt.
 */
-void
-vg_link_store(vgraph *g, char *node1, char *node2, vscalar *s)
+double
+vg_ipath_repair(vgraph *g)
 {
-    vlink *l;
+    double dist, maxdist = 0.0;
+    vlist *affected;
+    vqueue *queue;
+    int i, k, end;
+    vlink *l, *lnext;
+    vnode *n, *m;
+    vsearch *s;
+    viter iter;
 
     VG_CHECK(g);
 
-    l = vg_getlink(g, node1, node2);
-    if (l->val != NULL)
-        vs_destroy(l->val);
-    l->val = s;
+    if (g->cache == NULL)
+        return NOPATH;
 
-    l = vg_getlink(g, node2, node1);
-    if (l->val != NULL)
-        vs_destroy(l->val);
-    l->val = vs_copy(s);
+    /* Link and node indices are only valid in the same compiled form */
+    if (!g->compiled)
+        return vg_cache(g, g->cache);
+
+    s = vg_search_context(g);
+    vl_init(s->nodes);
+    affected = s->nodes;
+    queue = s->queue;
+    vq_empty(queue);
+
+    g->use_cache = 1;
+    searchflag++;
+    caching_now = 1;
+
+    /* Find nodes whose cached path goes through a changed link or node */
+    if (g->lchanged != NULL) {
+        v_iterate(g->lchanged, iter) {
+            l = g->linkvec[vl_iter_ival(iter)];
+            n = l->to;
+            if (n != g->cache && CACHED(g, n) && n->cache == l && !SEEN(n)) {
+                LOOKAT(n);
+                vl_ppush(affected, n);
+            }
+        }
+    }
+
+    if (g->nchanged != NULL) {
+        v_iterate(g->nchanged, iter) {
+            n = g->nodevec[vl_iter_ival(iter)];
+            if (n != g->cache && !SEEN(n)) {
+                LOOKAT(n);
+                vl_ppush(affected, n);
+            }
+        }
+    }
+
+    /* Add everything downstream of them in the cached tree */
+    for (i = 0; i < vl_length(affected); i++) {
+        n = vl_pget(affected, i);
+        if (!CACHED(g, n))
+            continue;
+
+        end = g->tstart[n->index + 1];
+        for (k = g->tstart[n->index]; k < end; k++) {
+            l = g->linkvec[g->tlinks[k]];
+            m = l->to;
+            if (m != g->cache && CACHED(g, m) && m->cache == l && !SEEN(m)) {
+                LOOKAT(m);
+                vl_ppush(affected, m);
+            }
+        }
+    }
+
+    /* Forget their paths */
+    v_iterate(affected, iter) {
+        n = vl_iter_pval(iter);
+        n->cachevisit = 0;
+    }
+
+    /* Queue best links into them from the rest of the tree */
+    v_iterate(affected, iter) {
+        n = vl_iter_pval(iter);
+
+        end = g->fstart[n->index + 1];
+        for (k = g->fstart[n->index]; k < end; k++) {
+            l = g->linkvec[g->flinks[k]];
+            if (!CACHED(g, l->from) || !USELINK(g, l))
+                continue;
+
+            l->dist = CACHEDIST(g, l->from) + vg_link_size(g, l);
+            vq_pstore(queue, l, -l->dist);
+            g->relaxed++;
+        }
+    }
+
+    /* Queue changed links which might make paths shorter */
+    if (g->lchanged != NULL) {
+        v_iterate(g->lchanged, iter) {
+            l = g->linkvec[vl_iter_ival(iter)];
+            n = l->to;
+            if (n == g->cache || SEEN(n) || !CACHED(g, l->from))
+                continue;
+
+            dist = CACHEDIST(g, l->from) + vg_link_size(g, l);
+            if (CACHED(g, n) && CACHEDIST(g, n) <= dist)
+                continue;
+
+            if (!USELINK(g, l))
+                continue;
+
+            l->dist = dist;
+            vq_pstore(queue, l, -dist);
+            g->relaxed++;
+        }
+    }
+
+    /* Do search */
+    while ((l = vq_pget(queue)) != NULL) {
+        /* Skip link if destination node is done or no closer */
+        n = l->to;
+        if (VISITED(n))
+            continue;
+
+        if (CACHED(g, n) && CACHEDIST(g, n) <= l->dist)
+            continue;
+
+        /* Skip link if destination node can't be used */
+        if (!USENODE(g, n, l->dist))
+            continue;
+
+        /* Update its cached path */
+        n->visit = searchflag;
+        n->cache = l;
+        n->cacheflag = n->cachevisit = cachecount;
+        l->cachedist = l->dist;
+        g->expanded++;
+
+        /* Add node links which give shorter paths */
+        end = g->tstart[n->index + 1];
+        for (k = g->tstart[n->index]; k < end; k++) {
+            lnext = g->linkvec[g->tlinks[k]];
+            m = lnext->to;
+            if (m == g->cache || VISITED(m))
+                continue;
+
+            dist = l->dist + vg_link_size(g, lnext);
+            if (CACHED(g, m) && CACHEDIST(g, m) <= dist)
+                continue;
+
+            if (!USELINK(g, lnext))
+                continue;
+
+            lnext->dist = dist;
+            vq_pstore(queue, lnext, -dist);
+            g->relaxed++;
+        }
+    }
+
+    caching_now = 0;
+
+    if (g->nchanged != NULL)
+        vl_empty(g->nchanged);
+    if (g->lchanged != NULL)
+        vl_empty(g->lchanged);
+
+    g->repaired = 1;
+
+    /* Find distance of furthest node */
+    for (i = 0; i < (int) g->nodes; i++) {
+        n = g->nodevec[i];
+        if (n != g->cache && CACHED(g, n))
+            maxdist = V_MAX(maxdist, CACHEDIST(g, n));
+    }
+
+    return maxdist;
 }
 
-/* Create a new link */
-static vlink *
-vg_newlink(vgraph *g, vnode *n1, vnode *n2, char *map)
+/* Return lower bound on path length between two nodes (or -1 if none) */
+static double
+vg_landmark_bound(vgraph *g, int node, int to)
+{
+    double *from, *back, bound = 0.0;
+    int k;
+
+    for (k = 0; k < g->lmcount; k++) {
+        from = g->lmdist + 2 * k * g->nodes;
+        back = from + g->nodes;
+
+        /* Landmark -> node -> target must be no shorter than direct */
+        if (from[node] >= 0.0) {
+            if (from[to] < 0.0)
+                return -1.0;
+            bound = V_MAX(bound, from[to] - from[node]);
+        }
+
+        /* Node -> target -> landmark must be no shorter than direct */
+        if (back[to] >= 0.0) {
+            if (back[node] < 0.0)
+                return -1.0;
+            bound = V_MAX(bound, back[node] - back[to]);
+        }
+    }
+
+    return bound;
+}
+
+/* Find unrestricted path lengths from (or to) a node */
+static void
+vg_landmark_search(vsearch *s, vnode *n, double *dist, int rev)
 {
+    int i, k, end, *start, *links;
+    vgraph *g = s->g;
+    double d = 0.0;
+    vnode *m = n;
     vlink *l;
 
-    l = V_ALLOC(vlink, 1);
+    start = (rev ? g->fstart : g->tstart);
+    links = (rev ? g->flinks : g->tlinks);
 
-    l->val = vs_create(V_TYPE_UNDEF);
-    l->from = n1;
-    l->to = n2;
+    for (i = 0; i < (int) g->nodes; i++)
+        dist[i] = NOPATH;
 
-    l->lprev = l->lnext = NULL;
-    l->fprev = l->fnext = NULL;
-    l->tprev = l->tnext = NULL;
+    vq_empty(s->queue);
+    s->stamp++;
+    s->visit[n->index] = s->stamp;
+    dist[n->index] = 0.0;
 
-    LINK(g, lhead, ltail, l, lprev, lnext);
-    LINK(n1, thead, ttail, l, tprev, tnext);
-    LINK(n2, fhead, ftail, l, fprev, fnext);
+    while (1) {
+        end = start[m->index + 1];
+        for (k = start[m->index]; k < end; k++) {
+            l = g->linkvec[links[k]];
+            if (SVISITED(s, rev ? l->from->index : l->to->index))
+                continue;
 
-    vh_pstore(g->linkmap, map, l);
-    g->links++;
+            s->dist[l->index] = d + vg_link_size(g, l);
+            vq_pstore(s->queue, l, -s->dist[l->index]);
+            s->relaxed++;
+        }
 
-    return l;
+        do {
+            l = vq_pget(s->queue);
+        } while (l != NULL && SVISITED(s, rev ? l->from->index
+                                             : l->to->index));
+
+        if (l == NULL)
+            break;
+
+        m = (rev ? l->from : l->to);
+        s->visit[m->index] = s->stamp;
+        s->expanded++;
+        d = dist[m->index] = s->dist[l->index];
+    }
 }
 
-/* Create a new node */
-static vnode *
-vg_newnode(vgraph *g, char *node)
+/* Choose landmark nodes and find path lengths from and to them */
+static void
+vg_landmarks(vgraph *g, vsearch *s)
+{
+    double *from, *back, sep, dist, maxsep;
+    int i, j, k, best = 0;
+
+    g->lmcount = V_MIN(g->landmarks, (int) g->nodes);
+    g->lmdist = V_ALLOC(double, 2 * V_MAX(g->lmcount, 1) * g->nodes + 1);
+
+    /*
+     * The first search finds a node on the edge of the graph.  After that,
+     * each landmark is the node furthest from the ones chosen so far (with
+     * nodes that can't reach them, or be reached, furthest of all).
+     */
+    for (k = -1; k < g->lmcount; k++) {
+        from = g->lmdist + 2 * V_MAX(k, 0) * g->nodes;
+        back = from + g->nodes;
+
+        vg_landmark_search(s, g->nodevec[best], from, 0);
+        vg_landmark_search(s, g->nodevec[best], back, 1);
+
+        maxsep = -1.0;
+        for (i = 0; i < (int) g->nodes; i++) {
+            sep = -1.0;
+
+            for (j = 0; j <= V_MAX(k, 0); j++) {
+                from = g->lmdist + 2 * j * g->nodes;
+                back = from + g->nodes;
+
+                if (from[i] < 0.0 || back[i] < 0.0)
+                    continue;
+
+                dist = from[i] + back[i];
+                if (sep < 0.0 || dist < sep)
+                    sep = dist;
+            }
+
+            /* Unconnected nodes come first */
+            if (sep < 0.0) {
+                best = i;
+                break;
+            }
+
+            if (sep > maxsep) {
+                maxsep = sep;
+                best = i;
+            }
+        }
+    }
+}
+
+/* Return length of a path between two nodes */
+static double
+vg_length(vgraph *g, vnode *n1, vnode *n2)
 {
     vnode *n;
 
-    n = V_ALLOC(vnode, 1);
+    if (n1 == n2)
+        return 0;
 
-    n->name = V_STRDUP(node);
-    n->id = ++g->idcount;
-    n->val = vs_create(V_TYPE_UNDEF);
+    if ((n = vg_path_visit(g, n1, n2, 0)) == NULL)
+        return NOPATH;
 
-    n->nprev = n->nnext = NULL;
-    n->fhead = n->ftail = NULL;
-    n->thead = n->ttail = NULL;
+    return PATHDIST(n);
+}
 
-    n->visit = n->seen = n->pathflag = n->cacheflag = -1;
-    n->path = n->cache = NULL;
-    n->cachevisit = -1;
+/*!
+  @brief   Flag a change in whether a link index can be used.
+  @ingroup graph_index
+  @param   g Graph.
+  @param   link Link index.
+  @see     vg_ipath_repair()
+*/
+void
+vg_link_changed(vgraph *g, int link)
+{
+    VG_CHECK(g);
 
-    LINK(g, nhead, ntail, n, nprev, nnext);
+    if (!LINK_OK(g, link))
+        return;
 
-    vh_pstore(g->nodemap, node, n);
-    g->nodes++;
+    if (g->lchanged == NULL)
+        g->lchanged = vl_create();
 
-    return n;
+    vl_ipush(g->lchanged, link);
 }
 
 /*!
-  @brief   Return number of nodes in a graph.
+  @brief   Return number of links in a graph.
   @ingroup graph_access
   @param   g Graph.
-  @return  No. of nodes.
+  @return  No. of links.
 */
 int
-vg_node_count(vgraph *g)
+vg_link_count(vgraph *g)
 {
     VG_CHECK(g);
-    return g->nodes;
+    return g->links;
 }
 
 /*!
-  @brief   Return whether a node exists.
+  @brief   Return whether a link exists.
   @ingroup graph_access
   @param   g Graph.
-  @param   node Node name.
+  @param   node1 From node.
+  @param   node2 To node.
   @return  Yes or no.
 */
 int
-vg_node_exists(vgraph *g, char *node)
+vg_link_exists(vgraph *g, char *node1, char *node2)
 {
+    vnode *n1, *n2;
+    vlink *l;
+
     VG_CHECK(g);
 
-    return vh_exists(g->nodemap, node);
+    FINDNODE(g, node1, n1);
+    FINDNODE(g, node2, n2);
+    if (n1 == NULL || n2 == NULL)
+        return 0;
+
+    FINDLINK(g, n1, n2, l);
+
+    return (l != NULL);
 }
 
 /*!
-  @brief   Return a list of nodes linked to a given node.
-  @ingroup graph_access
+  @brief   Return the node index a link goes from.
+  @ingroup graph_index
   @param   g Graph.
-  @param   node Node name.
-  @return  List of nodes.
-  @retval  @c NULL if the node doesn't exist.
+  @param   link Link index.
+  @return  Node index.
+  @retval  -1 if the link doesn't exist.
 */
-vlist *
-vg_node_from(vgraph *g, char *node)
+int
+vg_link_from(vgraph *g, int link)
 {
-    vlist *list;
-    vnode *n;
-    vlink *l;
-
     VG_CHECK(g);
-    FINDNODE(g, node, n);
-    if (n == NULL)
-        return NULL;
-
-    list = vl_create();
-    for (l = n->fhead; l != NULL; l = l->fnext)
-        vl_spush(list, l->from->name);
+    COMPILE(g);
 
-    return list;
+    return (LINK_OK(g, link) ? g->linkvec[link]->from->index : -1);
 }
 
 /*!
-  @brief   Return data associated with a node.
+  @brief   Return data associated with a link.
   @ingroup graph_access
   @param   g Graph.
-  @param   node Node name.
+  @param   node1 From node.
+  @param   node2 To node.
   @return  Value.
-  @retval  @c NULL if the node doesn't exist.
+  @retval  NULL if the link doesn't exist.
 */
 vscalar *
-vg_node_get(vgraph *g, char *node)
+vg_link_get(vgraph *g, char *node1, char *node2)
 {
-    vnode *n;
+    vnode *n1, *n2;
+    vlink *l;
 
     VG_CHECK(g);
 
-    FINDNODE(g, node, n);
-    return (n == NULL ? NULL : n->val);
-}
+    FINDNODE(g, node1, n1);
+    FINDNODE(g, node2, n2);
+    if (n1 == NULL || n2 == NULL)
+        return NULL;
 
-/*!
-  @brief   Return count of from/to links of a given node.
-  @ingroup graph_access
+    FINDLINK(g, n1, n2, l);
+
+    return (l == NULL ? NULL : l->val);
+}
+
+/*!
+  @brief   Return the index of a link between two node indices.
+  @ingroup graph_index
   @param   g Graph.
-  @param   node Node name.
-  @param[out]   from Pointer to no. of from links, or @c NULL.
-  @param[out]   to Pointer to no. of to links, or @c NULL.
-  @return  Total no. of from/to links.
+  @param   node1 From node index.
+  @param   node2 To node index.
+  @return  Link index.
+  @retval  -1 if the link doesn't exist.
 */
 int
-vg_node_links(vgraph *g, char *node, int *from, int *to)
+vg_link_index(vgraph *g, int node1, int node2)
 {
-    int links = 0;
-    vnode *n;
     vlink *l;
 
     VG_CHECK(g);
+    COMPILE(g);
 
-    FINDNODE(g, node, n);
-    if (n == NULL)
-        return 0;
+    if (!NODE_OK(g, node1) || !NODE_OK(g, node2))
+        return -1;
 
-    if (from != NULL)
-        *from = 0;
+    FINDLINK(g, g->nodevec[node1], g->nodevec[node2], l);
 
-    for (l = n->fhead; l != NULL; l = l->fnext) {
-        links++;
-        if (from != NULL)
-            *from++;
-    }
+    return (l == NULL ? -1 : l->index);
+}
 
-    if (to != NULL)
-        *to = 0;
+/*!
+  @brief   Declare a one-way link and associate data with it.
+  @ingroup graph_modify
+  @param   g Graph.
+  @param   node1 From node.
+  @param   node2 To node.
+  @param   s Value to store (or @c NULL).
 
-    for (l = n->thead; l != NULL; l = l->tnext) {
-        links++;
-        if (to != NULL)
-            *to++;
+  Firstly, if any of the named nodes don't exist, create them (with
+  undefined scalar values).  Then, if a link between the nodes doesn't
+  exist, create it.  Finally, replace its current scalar value (if any)
+  with the given value.
+*/
+void
+vg_link_oneway_store(vgraph *g, char *node1, char *node2, vscalar *s)
+{
+    vlink *l;
+
+    VG_CHECK(g);
+
+    l = vg_getlink(g, node1, node2);
+    if (l->val != NULL)
+        vs_destroy(l->val);
+    l->val = s;
+}
+
+/* Return the size of a link */
+static double
+vg_link_size(vgraph *g, vlink *l)
+{
+    double size;
+
+    if (g->link_size != NULL) {
+        size = (*g->link_size)(l->from->name, l->to->name, l->val);
+    } else {
+        switch (vs_type(l->val)) {
+        case V_TYPE_INT:
+        case V_TYPE_FLOAT:
+        case V_TYPE_DOUBLE:
+            size = vs_dget(l->val);
+            break;
+        default:
+            size = 1.0;
+            break;
+        }
     }
 
-    return links;
+    return (size >= 0.0 ? size : 0.0);
 }
 
 /*!
-  @brief   Return sorted list of nodes in a graph.
-  @ingroup graph_access
+  @brief   Set the link-size function of a graph.
+  @ingroup graph_connect
   @param   g Graph.
-  @return  List of nodes.
+  @param   func Function to calculate link size.
 */
-vlist *
-vg_node_list(vgraph *g)
+void
+vg_link_size_function(vgraph *g, double (*func)(char *node1, char *node2,
+                                                vscalar *s))
 {
     VG_CHECK(g);
-    return vh_keys(g->nodemap);
+    g->link_size = func;
 }
 
 /*!
-  @brief   Declare a node and associate data with it.
+  @brief   Declare a two-way link and associate the same data with both.
   @ingroup graph_modify
   @param   g Graph.
-  @param   node Node name.
-  @param   s Value.
+  @param   node1 From node.
+  @param   node2 To node.
+  @param   s Value to set.
 */
 void
-vg_node_store(vgraph *g, char *node, vscalar *s)
+vg_link_store(vgraph *g, char *node1, char *node2, vscalar *s)
 {
-    vnode *n;
+    vlink *l;
 
     VG_CHECK(g);
 
-    n = vg_getnode(g, node);
-    if (n->val != NULL)
-        vs_destroy(n->val);
-    n->val = s;    
+    l = vg_getlink(g, node1, node2);
+    if (l->val != NULL)
+        vs_destroy(l->val);
+    l->val = s;
+
+    l = vg_getlink(g, node2, node1);
+    if (l->val != NULL)
+        vs_destroy(l->val);
+    l->val = vs_copy(s);
 }
 
 /*!
-  @brief   Return a list of nodes a given node links to.
-  @ingroup graph_access
+  @brief   Return the node index a link goes to.
+  @ingroup graph_index
   @param   g Graph.
-  @param   node Node name.
-  @return  List of nodes.
-  @retval  @c NULL if the node doesn't exist.
+  @param   link Link index.
+  @return  Node index.
+  @retval  -1 if the link doesn't exist.
 */
-vlist *
-vg_node_to(vgraph *g, char *node)
+int
+vg_link_to(vgraph *g, int link)
 {
-    vlist *list;
-    vnode *n;
-    vlink *l;
-
     VG_CHECK(g);
+    COMPILE(g);
 
-    FINDNODE(g, node, n);
-    if (n == NULL)
-        return NULL;
-
-    list = vl_create();
-    for (l = n->thead; l != NULL; l = l->tnext)
-        vl_spush(list, l->to->name);
-
-    return list;
+    return (LINK_OK(g, link) ? g->linkvec[link]->to->index : -1);
 }
 
 /*!
-  @brief   Cache paths from a given node.
-  @ingroup graph_connect
+  @brief   Return data associated with a link index.
+  @ingroup graph_index
   @param   g Graph.
-  @param   node Node to cache from.
-  @return  Distance of furthest reachable node.
-
-  Do a single pass over a graph, starting from @c node, recording path
-  information for use in subsequent calls to vg_path_nodes(),
-  vg_path_length() or vg_path_exists().  If the first node in these calls
-  is the start node specified here, then this path information is used
-  instead of traversing the graph.  If @c node is @c NULL, caching of path
-  information is turned off (and the return value is not relevant).  Note
-  that if cached path information is used, the user-defined connection
-  functions will not be called.
+  @param   link Link index.
+  @return  Value.
+  @retval  @c NULL if the link doesn't exist.
 */
-double
-vg_path_cache(vgraph *g, char *node)
+vscalar *
+vg_link_value(vgraph *g, int link)
+{
+    VG_CHECK(g);
+    COMPILE(g);
+
+    return (LINK_OK(g, link) ? g->linkvec[link]->val : NULL);
+}
+
+/* Create a new link */
+static vlink *
+vg_newlink(vgraph *g, vnode *n1, vnode *n2)
+{
+    char map[30];
+    vlink *l;
+
+    l = V_ALLOC(vlink, 1);
+
+    l->val = vs_create(V_TYPE_UNDEF);
+    l->from = n1;
+    l->to = n2;
+
+    l->lprev = l->lnext = NULL;
+    l->fprev = l->fnext = NULL;
+    l->tprev = l->tnext = NULL;
+
+    LINK(g, lhead, ltail, l, lprev, lnext);
+    LINK(n1, thead, ttail, l, tprev, tnext);
+    LINK(n2, fhead, ftail, l, fprev, fnext);
+
+    LINKNAME(map, n1, n2);
+    vh_pstore(g->linkmap, map, l);
+    UNCOMPILE(g);
+    g->links++;
+
+    return l;
+}
+
+/* Create a new node */
+static vnode *
+vg_newnode(vgraph *g, char *node)
 {
     vnode *n;
 
-    VG_CHECK(g);
+    n = V_ALLOC(vnode, 1);
 
-    if (node != NULL) {
-        FINDNODE(g, node, n);
-        if (n != NULL) {
-            g->cache = n;
-            g->use_cache = 1;
-            cache_flag = 1;
+    n->name = V_STRDUP(node);
+    n->id = ++g->idcount;
+    n->val = vs_create(V_TYPE_UNDEF);
 
-            INIT_VISIT;
-            caching_now = 1;
-            n = vg_visit(g, n, NULL, V_PRIORITY, NULL);
-            caching_now = 0;
+    n->nprev = n->nnext = NULL;
+    n->fhead = n->ftail = NULL;
+    n->thead = n->ttail = NULL;
 
-            if (n == NULL || n->path == NULL)
-                return 0;
+    n->visit = n->seen = n->pathflag = n->cacheflag = -1;
+    n->path = n->cache = NULL;
+    n->cachevisit = -1;
 
-            return n->path->dist;
-        }
-    }
+    LINK(g, nhead, ntail, n, nprev, nnext);
 
-    g->cache = NULL;
-    g->use_cache = 0;
+    vh_pstore(g->nodemap, node, n);
+    UNCOMPILE(g);
+    g->nodes++;
 
-    return NOPATH;
+    return n;
 }
 
 /*!
-  @brief   Return whether a path exists between two nodes.
-  @ingroup graph_connect
+  @brief   Flag a change in whether a node index can be used.
+  @ingroup graph_index
   @param   g Graph.
-  @param   node1 From node.
-  @param   node2 To node.
-  @return  Yes or no.
-
-  Like vg_path_nodes(), but just return whether there is a path between the
-  given nodes.
+  @param   node Node index.
+  @see     vg_ipath_repair()
 */
-int
-vg_path_exists(vgraph *g, char *node1, char *node2)
+void
+vg_node_changed(vgraph *g, int node)
 {
-    vnode *n1, *n2;
-
     VG_CHECK(g);
 
-    FINDNODE(g, node1, n1);
-    FINDNODE(g, node2, n2);
-    if (n1 == NULL || n2 == NULL)
-        return 0;
-
-    if (n1 == n2)
-        return 1;
+    if (!NODE_OK(g, node))
+        return;
 
-    if (CHECK_CACHE(g, n1))
-        return HASPATH(n2);
-        
-    INIT_VISIT;
-    if (vg_visit(g, n1, n2, V_PRIORITY, NULL) == NULL)
-        return 0;
+    if (g->nchanged == NULL)
+        g->nchanged = vl_create();
 
-    return 1;
+    vl_ipush(g->nchanged, node);
 }
 
 /*!
-  @brief   Return list of info about path twixt two nodes.
-  @ingroup graph_connect
+  @brief   Return number of nodes in a graph.
+  @ingroup graph_access
   @param   g Graph.
-  @param   node1 From node.
-  @param   node2 To node.
-  @return  List.
-
-  Like vg_path_nodes(), but prepends the length of the path as the first
-  element in the list.
+  @return  No. of nodes.
 */
-vlist *
-vg_path_info(vgraph *g, char *node1, char *node2)
+int
+vg_node_count(vgraph *g)
 {
-    vnode *n1, *n2, *n;
-    vlist *path;
-    double len;
-
     VG_CHECK(g);
+    return g->nodes;
+}
 
-    FINDNODE(g, node1, n1);
-    FINDNODE(g, node2, n2);
-    if (n1 == NULL || n2 == NULL)
-        return NULL;
+/*!
+  @brief   Return whether a node exists.
+  @ingroup graph_access
+  @param   g Graph.
+  @param   node Node name.
+  @return  Yes or no.
+*/
+int
+vg_node_exists(vgraph *g, char *node)
+{
+    VG_CHECK(g);
 
-    if (n1 == n2) {
-        path = vl_create();
-        vl_spush(path, node1);
-        len = 0;
-    } else if (CHECK_CACHE(g, n1)) {
-        if (HASPATH(n2))
-            path = vg_build_path(g, n2);
-        else
-            return NULL;
-        len = n2->cache->cachedist;
-    } else {
-        INIT_VISIT;
-        if ((n = vg_visit(g, n1, n2, V_PRIORITY, NULL)) == NULL)
-            return NULL;
-        path = vg_build_path(g, n);
-        len = n2->path->dist;
+    return vh_exists(g->nodemap, node);
+}
+
+/*!
+  @brief   Return the links into a node index.
+  @ingroup graph_index
+  @param   g Graph.
+  @param   node Node index.
+  @param[out]   links Pointer to array of link indices.
+  @return  No. of links.
+
+  The returned array belongs to the graph, and is only valid until the
+  graph structure next changes.
+*/
+int
+vg_node_in(vgraph *g, int node, int **links)
+{
+    VG_CHECK(g);
+    COMPILE(g);
+
+    if (!NODE_OK(g, node)) {
+        *links = NULL;
+        return 0;
     }
 
-    vl_dunshift(path, len);
-    return path;
+    *links = g->flinks + g->fstart[node];
+    return g->fstart[node + 1] - g->fstart[node];
 }
 
 /*!
-  @brief   Return length of a path between two nodes.
-  @ingroup graph_connect
+  @brief   Return the index of a node.
+  @ingroup graph_index
   @param   g Graph.
-  @param   node1 From node.
-  @param   node2 To node.
-  @return  Path length.
-  @retval  Negative if there's no path.
+  @param   node Node name.
+  @return  Node index.
+  @retval  -1 if the node doesn't exist.
 */
-double
-vg_path_length(vgraph *g, char *node1, char *node2)
+int
+vg_node_index(vgraph *g, char *node)
 {
-    vnode *n1, *n2, *n;
+    vnode *n;
 
     VG_CHECK(g);
+    COMPILE(g);
 
-    FINDNODE(g, node1, n1);
-    FINDNODE(g, node2, n2);
-    if (n1 == NULL || n2 == NULL)
-        return NOPATH;
+    FINDNODE(g, node, n);
+    return (n == NULL ? -1 : n->index);
+}
 
-    if (n1 == n2)
+/*!
+  @brief   Return a list of nodes linked to a given node.
+  @ingroup graph_access
+  @param   g Graph.
+  @param   node Node name.
+  @return  List of nodes.
+  @retval  @c NULL if the node doesn't exist.
+*/
+vlist *
+vg_node_from(vgraph *g, char *node)
+{
+    vlist *list;
+    vnode *n;
+    vlink *l;
+
+    VG_CHECK(g);
+    FINDNODE(g, node, n);
+    if (n == NULL)
+        return NULL;
+
+    list = vl_create();
+    for (l = n->fhead; l != NULL; l = l->fnext)
+        vl_spush(list, l->from->name);
+
+    return list;
+}
+
+/*!
+  @brief   Return data associated with a node.
+  @ingroup graph_access
+  @param   g Graph.
+  @param   node Node name.
+  @return  Value.
+  @retval  @c NULL if the node doesn't exist.
+*/
+vscalar *
+vg_node_get(vgraph *g, char *node)
+{
+    vnode *n;
+
+    VG_CHECK(g);
+
+    FINDNODE(g, node, n);
+    return (n == NULL ? NULL : n->val);
+}
+
+/*!
+  @brief   Return count of from/to links of a given node.
+  @ingroup graph_access
+  @param   g Graph.
+  @param   node Node name.
+  @param[out]   from Pointer to no. of from links, or @c NULL.
+  @param[out]   to Pointer to no. of to links, or @c NULL.
+  @return  Total no. of from/to links.
+*/
+int
+vg_node_links(vgraph *g, char *node, int *from, int *to)
+{
+    int links = 0;
+    vnode *n;
+    vlink *l;
+
+    VG_CHECK(g);
+
+    FINDNODE(g, node, n);
+    if (n == NULL)
         return 0;
 
-    if (CHECK_CACHE(g, n1))
-        return (HASPATH(n2) ? n2->cache->cachedist : NOPATH);
+    if (from != NULL)
+        *from = 0;
 
-    INIT_VISIT;
-    if ((n = vg_visit(g, n1, n2, V_PRIORITY, NULL)) == NULL)
-        return NOPATH;
+    for (l = n->fhead; l != NULL; l = l->fnext) {
+        links++;
+        if (from != NULL)
+            *from++;
+    }
+
+    if (to != NULL)
+        *to = 0;
+
+    for (l = n->thead; l != NULL; l = l->tnext) {
+        links++;
+        if (to != NULL)
+            *to++;
+    }
 
-    return n->path->dist;
+    return links;
 }
 
 /*!
-  @brief   Return the links in a path twixt two nodes.
-  @ingroup graph_connect
+  @brief   Return the name of a node index.
+  @ingroup graph_index
   @param   g Graph.
-  @param   from From node.
-  @param   to To node.
-  @return  List of data associated with each link in the path.
-  @retval  @c NULL if a path doesn't exist.
+  @param   node Node index.
+  @return  Node name.
+  @retval  @c NULL if the node doesn't exist.
+*/
+char *
+vg_node_name(vgraph *g, int node)
+{
+    VG_CHECK(g);
+    COMPILE(g);
+
+    return (NODE_OK(g, node) ? g->nodevec[node]->name : NULL);
+}
+
+/*!
+  @brief   Return the links out of a node index.
+  @ingroup graph_index
+  @param   g Graph.
+  @param   node Node index.
+  @param[out]   links Pointer to array of link indices.
+  @return  No. of links.
+
+  The links are in the order they were added to the graph.  The returned
+  array belongs to the graph, and is only valid until the graph structure
+  next changes.
+*/
+int
+vg_node_out(vgraph *g, int node, int **links)
+{
+    VG_CHECK(g);
+    COMPILE(g);
+
+    if (!NODE_OK(g, node)) {
+        *links = NULL;
+        return 0;
+    }
+
+    *links = g->tlinks + g->tstart[node];
+    return g->tstart[node + 1] - g->tstart[node];
+}
+
+/*!
+  @brief   Return sorted list of nodes in a graph.
+  @ingroup graph_access
+  @param   g Graph.
+  @return  List of nodes.
 */
 vlist *
-vg_path_links(vgraph *g, char *from, char *to)
+vg_node_list(vgraph *g)
 {
-    vlist *links, *list;
-    vscalar *s;
-    int i, n;
+    VG_CHECK(g);
+    return vh_keys(g->nodemap);
+}
+
+/*!
+  @brief   Declare a node and associate data with it.
+  @ingroup graph_modify
+  @param   g Graph.
+  @param   node Node name.
+  @param   s Value.
+*/
+void
+vg_node_store(vgraph *g, char *node, vscalar *s)
+{
+    vnode *n;
 
     VG_CHECK(g);
 
-    if ((list = vg_path_nodes(g, from, to)) == NULL)
+    n = vg_getnode(g, node);
+    if (n->val != NULL)
+        vs_destroy(n->val);
+    n->val = s;    
+}
+
+/*!
+  @brief   Return a list of nodes a given node links to.
+  @ingroup graph_access
+  @param   g Graph.
+  @param   node Node name.
+  @return  List of nodes.
+  @retval  @c NULL if the node doesn't exist.
+*/
+vlist *
+vg_node_to(vgraph *g, char *node)
+{
+    vlist *list;
+    vnode *n;
+    vlink *l;
+
+    VG_CHECK(g);
+
+    FINDNODE(g, node, n);
+    if (n == NULL)
         return NULL;
 
-    links = vl_create();
-    n = vl_length(list);
+    list = vl_create();
+    for (l = n->thead; l != NULL; l = l->tnext)
+        vl_spush(list, l->to->name);
+
+    return list;
+}
+
+/*!
+  @brief   Return data associated with a node index.
+  @ingroup graph_index
+  @param   g Graph.
+  @param   node Node index.
+  @return  Value.
+  @retval  @c NULL if the node doesn't exist.
+*/
+vscalar *
+vg_node_value(vgraph *g, int node)
+{
+    VG_CHECK(g);
+    COMPILE(g);
+
+    return (NODE_OK(g, node) ? g->nodevec[node]->val : NULL);
+}
+
+/*!
+  @brief   Cache paths from a given node.
+  @ingroup graph_connect
+  @param   g Graph.
+  @param   node Node to cache from.
+  @return  Distance of furthest reachable node.
+
+  Do a single pass over a graph, starting from @c node, recording path
+  information for use in subsequent calls to vg_path_nodes(),
+  vg_path_length() or vg_path_exists().  If the first node in these calls
+  is the start node specified here, then this path information is used
+  instead of traversing the graph.  If @c node is @c NULL, caching of path
+  information is turned off (and the return value is not relevant).  Note
+  that if cached path information is used, the user-defined connection
+  functions will not be called.
+*/
+double
+vg_path_cache(vgraph *g, char *node)
+{
+    vnode *n = NULL;
+
+    VG_CHECK(g);
+
+    if (node != NULL)
+        FINDNODE(g, node, n);
+
+    return vg_cache(g, n);
+}
+
+/*!
+  @brief   Cache paths to a given node.
+  @ingroup graph_connect
+  @param   g Graph.
+  @param   node Node to cache paths to.
+  @return  Distance of furthest node that can reach it.
+
+  Like vg_path_cache(), but do a single pass over the graph backwards from
+  @c node, following links from the nodes they go to, and record the
+  length of the shortest path to @c node from every other node.  While
+  the cache is in use, vg_path_length() and vg_path_exists() calls whose
+  second node is @c node then use this information instead of traversing
+  the graph.  The connection functions are called in the same way as for
+  a forward search, so the lengths are the same.  The information is
+  forgotten by vg_cache_flush().  If @c node is @c NULL, it is forgotten
+  straight away.
+*/
+double
+vg_path_rcache(vgraph *g, char *node)
+{
+    vnode *n = NULL;
+
+    VG_CHECK(g);
+    COMPILE(g);
+
+    if (node != NULL)
+        FINDNODE(g, node, n);
+
+    return vg_rcache(g, n);
+}
+
+/*!
+  @brief   Return whether a path exists between two nodes.
+  @ingroup graph_connect
+  @param   g Graph.
+  @param   node1 From node.
+  @param   node2 To node.
+  @return  Yes or no.
+
+  Like vg_path_nodes(), but just return whether there is a path between the
+  given nodes.  If the path cache is in use, paths from nodes other than
+  the cache node are looked up with vg_ipath_reachable() instead of
+  searched for.
+*/
+int
+vg_path_exists(vgraph *g, char *node1, char *node2)
+{
+    vnode *n1, *n2;
+
+    VG_CHECK(g);
+
+    FINDNODE(g, node1, n1);
+    FINDNODE(g, node2, n2);
+    if (n1 == NULL || n2 == NULL)
+        return 0;
+
+    if (n1 == n2)
+        return 1;
+
+    if (g->use_cache && n1 != g->cache) {
+        COMPILE(g);
+        return vg_ipath_reachable(g, n1->index, n2->index);
+    }
+
+    return (vg_path_visit(g, n1, n2, 0) != NULL);
+}
+
+/*!
+  @brief   Return list of info about path twixt two nodes.
+  @ingroup graph_connect
+  @param   g Graph.
+  @param   node1 From node.
+  @param   node2 To node.
+  @return  List.
+
+  Like vg_path_nodes(), but prepends the length of the path as the first
+  element in the list.
+*/
+vlist *
+vg_path_info(vgraph *g, char *node1, char *node2)
+{
+    vnode *n1, *n2, *n;
+    vlist *path;
+    double len;
+
+    VG_CHECK(g);
+
+    FINDNODE(g, node1, n1);
+    FINDNODE(g, node2, n2);
+    if (n1 == NULL || n2 == NULL)
+        return NULL;
+
+    if (n1 == n2) {
+        path = vl_create();
+        vl_spush(path, node1);
+        len = 0;
+    } else if ((n = vg_path_visit(g, n1, n2, 1)) != NULL) {
+        path = vg_build_path(g, n);
+        len = PATHDIST(n);
+    } else {
+        return NULL;
+    }
+
+    vl_dunshift(path, len);
+    return path;
+}
+
+/*!
+  @brief   Return length of a path between two nodes.
+  @ingroup graph_connect
+  @param   g Graph.
+  @param   node1 From node.
+  @param   node2 To node.
+  @return  Path length.
+  @retval  Negative if there's no path.
+*/
+double
+vg_path_length(vgraph *g, char *node1, char *node2)
+{
+    vnode *n1, *n2;
+
+    VG_CHECK(g);
+
+    FINDNODE(g, node1, n1);
+    FINDNODE(g, node2, n2);
+    if (n1 == NULL || n2 == NULL)
+        return NOPATH;
+
+    return vg_length(g, n1, n2);
+}
+
+/*!
+  @brief   Return the links in a path twixt two nodes.
+  @ingroup graph_connect
+  @param   g Graph.
+  @param   from From node.
+  @param   to To node.
+  @return  List of data associated with each link in the path.
+  @retval  @c NULL if a path doesn't exist.
+*/
+vlist *
+vg_path_links(vgraph *g, char *from, char *to)
+{
+    vlist *links, *list;
+    vscalar *s;
+    int i, n;
+
+    VG_CHECK(g);
+
+    if ((list = vg_path_nodes(g, from, to)) == NULL)
+        return NULL;
+
+    links = vl_create();
+    n = vl_length(list);
+
+    for (i = 0; i < n - 1; i++) {
+        from = vl_sgetref(list, i);
+        to   = vl_sgetref(list, i + 1);
+        s = vg_link_get(g, from, to);
+        vl_push(links, vs_copy(s));
+    }
+
+    vl_destroy(list);
+    return links;
+}
+
+/*!
+  @brief   Return list of nodes twixt two nodes.
+  @ingroup graph_connect
+  @param   g Graph.
+  @param   node1 From node.
+  @param   node2 To node.
+  @return  List of nodes.
+  @retval  @c NULL if a path doesn't exist.
+
+  Given two nodes, return a list of nodes which constitutes a shortest path
+  from one node to the other.  Both the start and finish nodes are included
+  in the list.
+
+  The shortest path is calculated using the 'size' of each link.  The size
+  of a link is defined as follows.  Firstly, if the graph has an associated
+  link size function, then that is called on each link to find the link
+  size.  If not, then the link's scalar value is examined.  If this has a
+  numeric value (either V_TYPE_INT, V_TYPE_FLOAT or V_TYPE_DOUBLE) then
+  that is the link size.  Otherwise, the link size is 1.  A negative link
+  size is silently rounded up to zero.
+*/
+vlist *
+vg_path_nodes(vgraph *g, char *node1, char *node2)
+{
+    vnode *n1, *n2, *n;
+    vlist *path;
+
+    VG_CHECK(g);
+
+    FINDNODE(g, node1, n1);
+    FINDNODE(g, node2, n2);
+    if (n1 == NULL || n2 == NULL)
+        return NULL;
+
+    if (n1 == n2) {
+        path = vl_create();
+        vl_spush(path, node1);
+    } else if ((n = vg_path_visit(g, n1, n2, 1)) != NULL) {
+        path = vg_build_path(g, n);
+    } else {
+        path = NULL;
+    }
+
+    return path;
+}
+
+/*!
+  @brief   Return sorted list of nodes reachable from a given node.
+  @ingroup graph_connect
+  @param   g Graph.
+  @param   node Node to examine.
+  @return  List of nodes reachable from it.
+*/
+vlist *
+vg_path_reachable(vgraph *g, char *node)
+{
+    vlist *list;
+    char *other;
+    viter iter;
+
+    VG_CHECK(g);
+
+    vg_path_cache(g, node);
+    list = vl_create();
+
+    v_iterate(g->nodemap, iter) {
+        other = vh_iter_key(iter);
+        if (vg_path_exists(g, node, other))
+            vl_spush(list, other);
+    }
+
+    vl_sort(list, NULL);
+    return list;
+}
+
+/* Find a path from a non-cache node using cached paths */
+static vnode *
+vg_path_lookup(vgraph *g, vnode *n1, vnode *n2, int route)
+{
+    vpcache *c, *cuse = NULL;
+    int i, start;
+    vsearch *s;
+    vnode *n;
+    vlink *l;
+
+    COMPILE(g);
+
+    /* Look for paths from the start node */
+    start = n1->index;
+    for (i = 0; i < g->pcachecount; i++) {
+        c = &g->pcache[i];
+        if (c->node == start) {
+            cuse = c;
+            break;
+        }
+
+        if (cuse == NULL || c->used < cuse->used)
+            cuse = c;
+    }
+
+    if (cuse != NULL && cuse->node == start &&
+        cuse->generation == g->generation) {
+        g->hits++;
+    } else {
+        /* Not there (or out of date) -- find paths to everywhere */
+        g->misses++;
+
+        if (cuse == NULL || (cuse->node != start &&
+                             g->pcachecount < g->pcachesize)) {
+            if (g->pcache == NULL)
+                g->pcache = V_ALLOC(vpcache, g->pcachesize);
+
+            cuse = &g->pcache[g->pcachecount++];
+            cuse->dist = V_ALLOC(double, g->nodes + 1);
+            cuse->link = V_ALLOC(int, g->nodes + 1);
+        }
+
+        cuse->node = start;
+        cuse->generation = g->generation;
+
+        s = vg_search_context(g);
+        vg_search_priority(s, start, -1);
+
+        for (i = 0; i < (int) g->nodes; i++) {
+            if (i != start && SVISITED(s, i) && s->path[i] >= 0) {
+                cuse->dist[i] = s->dist[s->path[i]];
+                cuse->link[i] = s->path[i];
+            } else {
+                cuse->dist[i] = NOPATH;
+                cuse->link[i] = -1;
+            }
+        }
+    }
+
+    cuse->used = ++g->clock;
+
+    if (cuse->link[n2->index] < 0)
+        return NULL;
+
+    /* Set up path as if just searched for */
+    INIT_PATH;
+    for (n = n2; n != n1; n = l->from) {
+        l = g->linkvec[cuse->link[n->index]];
+        l->dist = cuse->dist[n->index];
+        n->path = l;
+        n->pathflag = pathcount;
+
+        if (!route)
+            break;
+    }
+
+    return n2;
+}
+
+/* Find a path to the reverse-cache node using cached lengths */
+static vnode *
+vg_path_rlookup(vgraph *g, vnode *n1, vnode *n2)
+{
+    vlink *l = NULL;
+    vnode *n;
+
+    g->hits++;
+
+    if (g->rlink[n1->index] < 0)
+        return NULL;
+
+    /* Set up last link of path as if just searched for */
+    for (n = n1; n != n2; n = l->to)
+        l = g->linkvec[g->rlink[n->index]];
+
+    INIT_PATH;
+    l->dist = g->rdist[n1->index];
+    n2->path = l;
+    n2->pathflag = pathcount;
+
+    return n2;
+}
+
+/* Find a path between two distinct nodes and return the end node */
+static vnode *
+vg_path_visit(vgraph *g, vnode *n1, vnode *n2, int route)
+{
+    vsearch *s;
+
+    if (CHECK_CACHE(g, n1)) {
+        if (!HASPATH(n2)) {
+            g->hits++;
+            return NULL;
+        }
+
+        /* Repaired cache has the right lengths, but maybe not routes */
+        if (!route || !g->repaired) {
+            g->hits++;
+            return n2;
+        }
+
+        NOCACHE;
+    } else if (g->use_cache && !route && n2 == g->rcache &&
+               g->rgeneration == g->generation) {
+        return vg_path_rlookup(g, n1, n2);
+    } else if (g->use_cache && g->pcachesize > 0) {
+        return vg_path_lookup(g, n1, n2, route);
+    }
+
+    s = vg_search_prepare(g);
+    return vg_search_copy(s, n1, vg_search_visit(s, n1->index, n2->index),
+                          route);
+}
+
+/* Free paths cached from non-cache nodes */
+static void
+vg_pcache_free(vgraph *g)
+{
+    int i;
+
+    for (i = 0; i < g->pcachecount; i++) {
+        V_DEALLOC(g->pcache[i].dist);
+        V_DEALLOC(g->pcache[i].link);
+    }
+
+    V_DEALLOC(g->pcache);
+    g->pcachecount = 0;
+}
+
+/* Cache path lengths to a given node (or forget them) */
+static double
+vg_rcache(vgraph *g, vnode *n)
+{
+    double dist, maxdist = 0.0;
+    vlink *l, *lprev;
+    vqueue *queue;
+    int i, k, end;
+    vnode *m;
+
+    g->rcache = n;
+    if (n == NULL)
+        return NOPATH;
+
+    if (g->rdist == NULL) {
+        g->rdist = V_ALLOC(double, g->nodes + 1);
+        g->rlink = V_ALLOC(int, g->nodes + 1);
+    }
+
+    for (i = 0; i < (int) g->nodes; i++) {
+        g->rdist[i] = NOPATH;
+        g->rlink[i] = -1;
+    }
+
+    g->rgeneration = g->generation;
+    g->rdist[n->index] = 0.0;
+
+    queue = vg_search_context(g)->queue;
+    vq_empty(queue);
+    searchflag++;
+    caching_now = 1;
+
+    n->visit = searchflag;
+    dist = 0.0;
+    m = n;
+
+    while (1) {
+        /* Add links into this node if it can be passed through */
+        if (USENODE(g, m, dist)) {
+            end = g->fstart[m->index + 1];
+            for (k = g->fstart[m->index]; k < end; k++) {
+                lprev = g->linkvec[g->flinks[k]];
+                if (VISITED(lprev->from) || !USELINK(g, lprev))
+                    continue;
+
+                lprev->dist = dist + vg_link_size(g, lprev);
+                vq_pstore(queue, lprev, -lprev->dist);
+                g->relaxed++;
+            }
+        } else if (m == n) {
+            /* Nothing can reach the end node if it can't be used */
+            break;
+        }
+
+        /* Get next closest node, skipping ones already done */
+        do {
+            l = vq_pget(queue);
+        } while (l != NULL && VISITED(l->from));
+
+        if (l == NULL)
+            break;
+
+        /* Any node can start a path, even if it can't be passed through */
+        m = l->from;
+        m->visit = searchflag;
+        g->expanded++;
+        dist = l->dist;
+        g->rdist[m->index] = dist;
+        g->rlink[m->index] = l->index;
+        maxdist = V_MAX(maxdist, dist);
+    }
+
+    caching_now = 0;
+
+    return maxdist;
+}
+
+/* Print contents of a graph */
+void
+vg_print(vgraph *g, FILE *fp)
+{
+    vnode *n;
+    vlink *l;
+
+    VG_CHECK(g);
+
+    v_print_start();
+    v_push_indent();
+
+    v_print_type(vgraph_type, g, fp);
+
+    for (n = g->nhead; n != NULL; n = n->nnext) {
+        v_indent(fp);
+        fprintf(fp, "NODE %s => ", n->name);
+        v_print(n->val, fp);
+    }
+
+    for (l = g->lhead; l != NULL; l = l->lnext) {
+        v_indent(fp);
+        fprintf(fp, "LINK %s TO %s => ", l->from->name, l->to->name);
+        v_print(l->val, fp);
+    }
+
+    v_pop_indent();
+    v_print_finish();
+}
+
+/* Return whether one node can reach another using the index */
+static int
+vg_reaches(vgraph *g, int node1, int node2)
+{
+    int k, c, end, c2 = g->icomp[node2];
+
+    /* End node must be usable */
+    if (c2 < 0)
+        return 0;
+
+    if ((c = g->icomp[node1]) >= 0)
+        return IREACHES(g, c, c2);
+
+    /* Start node needn't be usable, but its links must */
+    end = g->tstart[node1 + 1];
+    for (k = g->tstart[node1]; k < end; k++) {
+        if (!g->ilink[g->tlinks[k]])
+            continue;
+
+        if ((c = g->icomp[g->tnodes[k]]) >= 0 && IREACHES(g, c, c2))
+            return 1;
+    }
+
+    return 0;
+}
+
+/* Read graph from a stream */
+vgraph *
+vg_read(FILE *fp)
+{
+    char *name, *node1, *node2;
+    int n1, n2, num;
+    vlist *nodes;
+    vscalar *s;
+    vgraph *g;
+    int i;
+
+    g = vg_create();
+    nodes = vl_create();
+
+    /* Read nodes */
+    if (!v_read_long(&num, fp))
+        return NULL;
+
+    for (i = 0; i < num; i++) {
+        if ((name = v_read_string(fp)) == NULL)
+            return NULL;
+        if ((s = vs_read(fp)) == NULL)
+            return NULL;
+
+        vg_node_store(g, name, s);
+        vl_spush(nodes, name);
+    }
+
+    /* Read links */
+    if (!v_read_long(&num, fp))
+        return NULL;
+
+    for (i = 0; i < num; i++) {
+        if (!v_read_long(&n1, fp))
+            return NULL;
+        if (!v_read_long(&n2, fp))
+            return NULL;
+        if ((s = vs_read(fp)) == NULL)
+            return NULL;
+
+        node1 = vl_sgetref(nodes, n1);
+        node2 = vl_sgetref(nodes, n2);
+        vg_link_oneway_store(g, node1, node2, s);
+    }
+
+    vl_destroy(nodes);
+
+    return g;
+}
+
+/* Find a path between two nodes directed by landmarks */
+static int
+vg_search_astar(vsearch *s, int from, int to)
+{
+    double dist = 0.0, best = -1.0, bound, size;
+    int k, end, n = from, m, ties;
+    vgraph *g = s->g;
+    vlink *l, *lnext;
+
+    vq_empty(s->queue);
+    s->stamp++;
+    s->visit[from] = s->stamp;
+    s->path[from] = -1;
+
+    /*
+     * Like a priority search, but links are taken in order of their
+     * distance plus a lower bound on the distance still to go.  The
+     * bounds are consistent, so the first path found to a node is a
+     * shortest one.  Once the target is reached, carry on until every
+     * node that could be on a shortest path to it has been visited.
+     */
+    while (1) {
+        /* Add node links to queue */
+        end = g->tstart[n + 1];
+        for (k = g->tstart[n]; k < end; k++) {
+            lnext = g->linkvec[g->tlinks[k]];
+
+            /* Skip if destination node visited */
+            if (SVISITED(s, lnext->to->index))
+                continue;
+
+            /* Skip link if it can't be used */
+            if (!USELINK(g, lnext))
+                continue;
+
+            /* Skip link if the target can't be reached from it */
+            bound = vg_landmark_bound(g, lnext->to->index, to);
+            if (bound < 0.0)
+                continue;
+
+            s->dist[lnext->index] = dist + vg_link_size(g, lnext);
+            vq_pstore(s->queue, lnext, -(s->dist[lnext->index] + bound));
+            s->relaxed++;
+        }
+
+        /* Get next closest node, skipping ones done or unusable */
+        do {
+            if ((l = vq_pget(s->queue)) == NULL)
+                break;
+            m = l->to->index;
+            if (best >= 0.0 && !SVISITED(s, m) &&
+                s->dist[l->index] + vg_landmark_bound(g, m, to) > best)
+                l = NULL;
+        } while (l != NULL && (SVISITED(s, m) ||
+                               !USENODE(g, l->to, s->dist[l->index])));
+
+        if (l == NULL)
+            break;
+
+        /* Flag node as visited */
+        n = m;
+        s->visit[n] = s->stamp;
+        s->path[n] = l->index;
+        s->expanded++;
+        dist = s->dist[l->index];
+
+        /* Note when target node reached */
+        if (n == to)
+            best = dist;
+    }
+
+    if (best < 0.0)
+        return -1;
+
+    /*
+     * A priority search breaks ties between shortest paths in the order
+     * links come off its queue, which can't be mimicked here.  So if any
+     * node on the path can be reached by more than one shortest link, do
+     * one of those instead.
+     */
+    for (n = to; n != from; n = g->linkvec[s->path[n]]->from->index) {
+        dist = s->dist[s->path[n]];
+        ties = 0;
+
+        end = g->fstart[n + 1];
+        for (k = g->fstart[n]; k < end; k++) {
+            l = g->linkvec[g->flinks[k]];
+            m = l->from->index;
+
+            if (!SVISITED(s, m) || !USELINK(g, l))
+                continue;
+
+            size = vg_link_size(g, l);
+            if (m != from)
+                size += s->dist[s->path[m]];
+
+            if (size == dist && ++ties > 1)
+                return vg_search_priority(s, from, to);
+        }
+    }
+
+    return to;
+}
+
+/*!
+  @brief   Start a path search context.
+  @ingroup graph_search
+  @param   g Graph.
+  @return  Search context.
+
+  The graph is got ready for searching first, if required.  This writes
+  to the graph, so it mustn't be done while other contexts are searching
+  it.
+*/
+vsearch *
+vg_search_begin(vgraph *g)
+{
+    VG_CHECK(g);
+    vg_search_prepare(g);
+    return vg_search_create(g);
+}
+
+/* Return the graph's own search context */
+static vsearch *
+vg_search_context(vgraph *g)
+{
+    COMPILE(g);
+
+    if (g->search == NULL)
+        g->search = vg_search_create(g);
+
+    return g->search;
+}
+
+/* Set up a path found in a search context as if just searched for */
+static vnode *
+vg_search_copy(vsearch *s, vnode *n1, int end, int route)
+{
+    vgraph *g = s->g;
+    vnode *n, *n2;
+    vlink *l;
+
+    if (end < 0)
+        return NULL;
+
+    INIT_PATH;
+    n2 = g->nodevec[end];
+
+    for (n = n2; n != n1; n = l->from) {
+        l = g->linkvec[s->path[n->index]];
+        l->dist = s->dist[l->index];
+        n->path = l;
+        n->pathflag = pathcount;
+
+        if (!route)
+            break;
+    }
+
+    return n2;
+}
+
+/* Create a search context for a compiled graph */
+static vsearch *
+vg_search_create(vgraph *g)
+{
+    vsearch *s;
+
+    s = V_ALLOC(vsearch, 1);
+    s->g = g;
+    s->queue = vq_create();
+    s->stamp = 0;
+
+    s->visit = V_CALLOC(int, g->nodes + 1);
+    s->seen = V_CALLOC(int, g->nodes + 1);
+    s->path = V_ALLOC(int, g->nodes + 1);
+    s->dist = V_ALLOC(double, g->links + 1);
+
+    /* This also sets up the list type before any searching */
+    s->nodes = vl_create();
+    s->expanded = s->relaxed = 0;
+
+    return s;
+}
+
+/*!
+  @brief   Finish with a path search context.
+  @ingroup graph_search
+  @param   s Search context.
+
+  The context's search counts are added to the graph's totals, so this
+  mustn't be done while other contexts are searching the graph.
+*/
+void
+vg_search_end(vsearch *s)
+{
+    s->g->expanded += s->expanded;
+    s->g->relaxed += s->relaxed;
+
+    vq_destroy(s->queue);
+    vl_destroy(s->nodes);
+
+    V_DEALLOC(s->visit);
+    V_DEALLOC(s->seen);
+    V_DEALLOC(s->path);
+    V_DEALLOC(s->dist);
+    V_DEALLOC(s);
+}
+
+/*!
+  @brief   Return list of info about path twixt two node indices.
+  @ingroup graph_search
+  @param   s Search context.
+  @param   node1 From node index.
+  @param   node2 To node index.
+  @return  List of path length followed by node indices.
+  @retval  @c NULL if a path doesn't exist.
+  @see     vg_ipath_info()
+*/
+vlist *
+vg_search_info(vsearch *s, int node1, int node2)
+{
+    vlist *path;
+
+    if ((path = vg_search_nodes(s, node1, node2)) == NULL)
+        return NULL;
+
+    if (node1 == node2)
+        vl_dunshift(path, 0.0);
+    else
+        vl_dunshift(path, s->dist[s->path[node2]]);
+
+    return path;
+}
+
+/*!
+  @brief   Return length of a path between two node indices.
+  @ingroup graph_search
+  @param   s Search context.
+  @param   node1 From node index.
+  @param   node2 To node index.
+  @return  Path length.
+  @retval  Negative if there's no path.
+  @see     vg_ipath_length()
+*/
+double
+vg_search_length(vsearch *s, int node1, int node2)
+{
+    vgraph *g = s->g;
+    int n;
+
+    if (!NODE_OK(g, node1) || !NODE_OK(g, node2))
+        return NOPATH;
+
+    if (node1 == node2)
+        return 0.0;
 
-    for (i = 0; i < n - 1; i++) {
-        from = vl_sgetref(list, i);
-        to   = vl_sgetref(list, i + 1);
-        s = vg_link_get(g, from, to);
-        vl_push(links, vs_copy(s));
-    }
+    if ((n = vg_search_visit(s, node1, node2)) < 0)
+        return NOPATH;
 
-    vl_destroy(list);
-    return links;
+    return s->dist[s->path[n]];
 }
 
 /*!
-  @brief   Return list of nodes twixt two nodes.
-  @ingroup graph_connect
-  @param   g Graph.
-  @param   node1 From node.
-  @param   node2 To node.
-  @return  List of nodes.
+  @brief   Return list of node indices in path twixt two node indices.
+  @ingroup graph_search
+  @param   s Search context.
+  @param   node1 From node index.
+  @param   node2 To node index.
+  @return  List of node indices.
   @retval  @c NULL if a path doesn't exist.
-
-  Given two nodes, return a list of nodes which constitutes a shortest path
-  from one node to the other.  Both the start and finish nodes are included
-  in the list.
-
-  The shortest path is calculated using the 'size' of each link.  The size
-  of a link is defined as follows.  Firstly, if the graph has an associated
-  link size function, then that is called on each link to find the link
-  size.  If not, then the link's scalar value is examined.  If this has a
-  numeric value (either V_TYPE_INT, V_TYPE_FLOAT or V_TYPE_DOUBLE) then
-  that is the link size.  Otherwise, the link size is 1.  A negative link
-  size is silently rounded up to zero.
+  @see     vg_ipath_nodes()
 */
 vlist *
-vg_path_nodes(vgraph *g, char *node1, char *node2)
+vg_search_nodes(vsearch *s, int node1, int node2)
 {
-    vnode *n1, *n2, *n;
+    vgraph *g = s->g;
     vlist *path;
+    int n;
 
-    VG_CHECK(g);
+    if (!NODE_OK(g, node1) || !NODE_OK(g, node2))
+        return NULL;
 
-    FINDNODE(g, node1, n1);
-    FINDNODE(g, node2, n2);
-    if (n1 == NULL || n2 == NULL)
+    if (node1 != node2 && vg_search_visit(s, node1, node2) < 0)
         return NULL;
 
-    if (n1 == n2) {
-        path = vl_create();
-        vl_spush(path, node1);
-    } else if (CHECK_CACHE(g, n1)) {
-        if (HASPATH(n2))
-            path = vg_build_path(g, n2);
-        else
-            return NULL;
-    } else {
-        INIT_VISIT;
-        if ((n = vg_visit(g, n1, n2, V_PRIORITY, NULL)) == NULL)
-            return NULL;
-        path = vg_build_path(g, n);
-    }
+    path = vl_create();
+    for (n = node2; n != node1; n = g->linkvec[s->path[n]]->from->index)
+        vl_iunshift(path, n);
+    vl_iunshift(path, node1);
 
     return path;
 }
 
-/*!
-  @brief   Return sorted list of nodes reachable from a given node.
-  @ingroup graph_connect
-  @param   g Graph.
-  @param   node Node to examine.
-  @return  List of nodes reachable from it.
-*/
-vlist *
-vg_path_reachable(vgraph *g, char *node)
+/* Do a priority search from a node, and return the last node visited */
+static int
+vg_search_priority(vsearch *s, int from, int to)
 {
-    vlist *list;
-    char *other;
-    viter iter;
+    int k, end, n, m;
+    vgraph *g = s->g;
+    vlink *l, *lnext;
+    double dist;
 
-    VG_CHECK(g);
+    vq_empty(s->queue);
+    s->stamp++;
 
-    vg_path_cache(g, node);
-    list = vl_create();
+    /* Set up initial links in queue */
+    end = g->tstart[from + 1];
+    for (k = g->tstart[from]; k < end; k++) {
+        l = g->linkvec[g->tlinks[k]];
+        if (USELINK(g, l)) {
+            s->dist[l->index] = vg_link_size(g, l);
+            vq_pstore(s->queue, l, -s->dist[l->index]);
+            s->relaxed++;
 
-    v_iterate(g->nodemap, iter) {
-        other = vh_iter_key(iter);
-        if (vg_path_exists(g, node, other))
-            vl_spush(list, other);
+            /* Flag destination node as looked-at */
+            m = l->to->index;
+            s->seen[m] = s->stamp;
+            s->path[m] = l->index;
+        }
     }
 
-    vl_sort(list, NULL);
-    return list;
-}
+    /* Flag start node as visited */
+    s->visit[from] = s->stamp;
+    s->path[from] = -1;
 
-/* Print contents of a graph */
-void
-vg_print(vgraph *g, FILE *fp)
-{
-    vnode *n;
-    vlink *l;
+    /* Do search */
+    n = from;
+    while ((l = vq_pget(s->queue)) != NULL) {
+        /* Skip link if destination node has been visited */
+        n = l->to->index;
+        if (SVISITED(s, n))
+            continue;
 
-    VG_CHECK(g);
+        /* Skip link if destination node can't be used */
+        dist = s->dist[l->index];
+        if (!USENODE(g, l->to, dist))
+            continue;
 
-    v_print_start();
-    v_push_indent();
+        /* Use this link if shorter than the one first seen */
+        if (SSEEN(s, n) && s->dist[s->path[n]] > dist)
+            s->path[n] = l->index;
 
-    v_print_type(vgraph_type, g, fp);
+        /* Flag node as visited */
+        s->visit[n] = s->stamp;
+        s->expanded++;
 
-    for (n = g->nhead; n != NULL; n = n->nnext) {
-        v_indent(fp);
-        fprintf(fp, "NODE %s => ", n->name);
-        v_print(n->val, fp);
-    }
+        /* If target node reached, that's it */
+        if (n == to)
+            break;
 
-    for (l = g->lhead; l != NULL; l = l->lnext) {
-        v_indent(fp);
-        fprintf(fp, "LINK %s TO %s => ", l->from->name, l->to->name);
-        v_print(l->val, fp);
-    }
+        /* Add node links to queue */
+        end = g->tstart[n + 1];
+        for (k = g->tstart[n]; k < end; k++) {
+            lnext = g->linkvec[g->tlinks[k]];
+            m = lnext->to->index;
 
-    v_pop_indent();
-    v_print_finish();
-}
+            /* Skip if destination node visited */
+            if (SVISITED(s, m))
+                continue;
 
-/* Read graph from a stream */
-vgraph *
-vg_read(FILE *fp)
-{
-    char *name, *node1, *node2;
-    int n1, n2, num;
-    vlist *nodes;
-    vscalar *s;
-    vgraph *g;
-    int i;
+            /* Skip link if it can't be used */
+            if (!USELINK(g, lnext))
+                continue;
 
-    g = vg_create();
-    nodes = vl_create();
+            /* Add link */
+            s->dist[lnext->index] = dist + vg_link_size(g, lnext);
+            vq_pstore(s->queue, lnext, -s->dist[lnext->index]);
+            s->relaxed++;
 
-    /* Read nodes */
-    if (!v_read_long(&num, fp))
-        return NULL;
+            /* Flag destination node as looked-at if required */
+            if (!SSEEN(s, m)) {
+                s->seen[m] = s->stamp;
+                s->path[m] = lnext->index;
+            }
+        }
+    }
 
-    for (i = 0; i < num; i++) {
-        if ((name = v_read_string(fp)) == NULL)
-            return NULL;
-        if ((s = vs_read(fp)) == NULL)
-            return NULL;
+    /* If destination not found (or not usable), fail */
+    if (to >= 0 && (n != to || !SVISITED(s, to)))
+        return -1;
 
-        vg_node_store(g, name, s);
-        vl_spush(nodes, name);
-    }
+    return n;
+}
 
-    /* Read links */
-    if (!v_read_long(&num, fp))
-        return NULL;
+/* Get a graph ready to search, and return its own search context */
+static vsearch *
+vg_search_prepare(vgraph *g)
+{
+    vsearch *s = vg_search_context(g);
 
-    for (i = 0; i < num; i++) {
-        if (!v_read_long(&n1, fp))
-            return NULL;
-        if (!v_read_long(&n2, fp))
-            return NULL;
-        if ((s = vs_read(fp)) == NULL)
-            return NULL;
+    if (g->landmarks > 0 && g->lmdist == NULL)
+        vg_landmarks(g, s);
 
-        node1 = vl_sgetref(nodes, n1);
-        node2 = vl_sgetref(nodes, n2);
-        vg_link_oneway_store(g, node1, node2, s);
-    }
+    return s;
+}
 
-    vl_destroy(nodes);
+/* Find a path between two nodes and return the end node (or -1) */
+static int
+vg_search_visit(vsearch *s, int from, int to)
+{
+    if (s->g->lmdist != NULL)
+        return vg_search_astar(s, from, to);
 
-    return g;
+    return vg_search_priority(s, from, to);
 }
 
 /* Thaw a graph from file */
@@ -1610,19 +3567,27 @@ vg_traverse(vgraph *g, int (*func)(void *ptr))
   @param   g Graph.
   @return  List of nodes.
   @retval  NULL if cycles exist.
+
+  The sort is a depth-first search without recursion, so it can cope with
+  very large graphs.  Each node comes after all the nodes that link to
+  it.  Strongly connected components are found in the same pass, and one
+  cycle from each component that has any is recorded for
+  vg_tsort_cycles().
 */
 vlist *
 vg_tsort(vgraph *g)
 {
+    int i, n, m, top, sp, count, comp, nodes;
+    int *num, *low, *iter, *calls, *stack, *icomp;
     vlist *order, *cycle;
-    vnode *n;
+    int cyclic;
 
     VG_CHECK(g);
+    COMPILE(g);
 
     /* Initialise */
-    NOCACHE;
-    INIT_VISIT;
     order = vl_create();
+    nodes = g->nodes;
 
     if (tsort_cycles == NULL) {
         tsort_cycles = vl_create();
@@ -1631,18 +3596,92 @@ vg_tsort(vgraph *g)
         vl_destroy(cycle);
     }
 
-    /* Visit all nodes */
-    for (n = g->nhead; n != NULL; n = n->nnext) {
-        if (VISITED(n))
+    num = V_ALLOC(int, nodes + 1);
+    low = V_ALLOC(int, nodes + 1);
+    iter = V_ALLOC(int, nodes + 1);
+    calls = V_ALLOC(int, nodes + 1);
+    stack = V_ALLOC(int, nodes + 1);
+    icomp = V_ALLOC(int, nodes + 1);
+
+    for (i = 0; i < nodes; i++)
+        num[i] = icomp[i] = -1;
+
+    count = comp = sp = 0;
+
+    /* Visit all nodes, following links backwards */
+    for (i = 0; i < nodes; i++) {
+        if (num[i] >= 0)
             continue;
 
         if (V_DEBUG(V_DBG_INTERN))
-            fprintf(stderr, "Starting from '%s'", n->name);
+            fprintf(stderr, "Starting from '%s'", g->nodevec[i]->name);
+
+        top = 0;
+        calls[0] = i;
+        iter[i] = g->fstart[i];
+        num[i] = low[i] = count++;
+        stack[sp++] = i;
+
+        while (top >= 0) {
+            n = calls[top];
+
+            if (iter[n] < g->fstart[n + 1]) {
+                /* Look at next node that links to this one */
+                m = g->fnodes[iter[n]++];
+
+                if (num[m] < 0) {
+                    if (V_DEBUG(V_DBG_INTERN))
+                        fprintf(stderr, "   Visiting '%s'",
+                                g->nodevec[m]->name);
+
+                    calls[++top] = m;
+                    iter[m] = g->fstart[m];
+                    num[m] = low[m] = count++;
+                    stack[sp++] = m;
+                } else if (icomp[m] < 0) {
+                    low[n] = V_MIN(low[n], num[m]);
+                }
+
+                continue;
+            }
+
+            /* All done -- add it to sorted list */
+            vl_spush(order, g->nodevec[n]->name);
+
+            /* Pop its component if it's the first node visited in it */
+            if (low[n] == num[n]) {
+                cyclic = (stack[sp - 1] != n);
+
+                do {
+                    m = stack[--sp];
+                    icomp[m] = comp;
+                } while (m != n);
+
+                if (cyclic) {
+                    cycle = vg_tsort_cycle(g, n, icomp, stack + sp);
+                    vl_ppush(tsort_cycles, cycle);
+                    if (V_DEBUG(V_DBG_INTERN))
+                        fprintf(stderr, "\nCycle found: %s\n",
+                                vl_join(cycle, " -> "));
+                }
+
+                comp++;
+            }
 
-        INIT_PATH;
-        vg_tsort_visit(g, n, order);
+            if (--top >= 0) {
+                m = calls[top];
+                low[m] = V_MIN(low[m], low[n]);
+            }
+        }
     }
 
+    V_DEALLOC(num);
+    V_DEALLOC(low);
+    V_DEALLOC(iter);
+    V_DEALLOC(calls);
+    V_DEALLOC(stack);
+    V_DEALLOC(icomp);
+
     if (vl_length(tsort_cycles) > 0) {
         vl_destroy(order);
         return NULL;
@@ -1656,10 +3695,12 @@ vg_tsort(vgraph *g)
   @ingroup graph_sort
   @return  List of cycles.
 
-  If vg_tsort() returned @c NULL, this function returns all the distinct
-  cycles found in the graph, as a list of lists of nodes.  Note that this
-  function returns a pointer to an internal list, which will be clobbered
-  the next time vg_tsort() is called.
+  If vg_tsort() returned @c NULL, this function returns a shortest cycle
+  from each strongly connected component that has any, as a list of lists
+  of nodes.  Other cycles in the same component aren't listed, so fixing
+  the ones returned may reveal more.  Note that this function returns a
+  pointer to an internal list, which will be clobbered the next time
+  vg_tsort() is called.
 */
 vlist *
 vg_tsort_cycles(void)
@@ -1673,60 +3714,88 @@ vg_tsort_cycles(void)
     return tsort_cycles;
 }
 
-/* Recursive topological sort visit function */
-static void
-vg_tsort_visit(vgraph *g, vnode *n, vlist *order)
+/* Find a shortest cycle through a node in a strongly connected component */
+static vlist *
+vg_tsort_cycle(vgraph *g, int root, int *icomp, int *queue)
 {
-    vnode *f, *start, *first;
+    int n = root, m, k, end, head = 0, tail = 0, comp = icomp[root];
     vlist *cycle;
-    int newcycle;
-    vlink *l;
 
-    /* Visit this node */
-    if (V_DEBUG(V_DBG_INTERN))
-        fprintf(stderr, "   Visiting '%s'", n->name);
+    /*
+     * Search backwards from the root until a node linking to it is found.
+     * Each node reached is marked by taking it out of the component, and
+     * the queue slots hold the node each one was reached from.
+     */
+    queue[tail++] = root;
+    icomp[root] = -2;
+
+    while (head < tail) {
+        n = queue[head++];
+        end = g->fstart[n + 1];
+
+        for (k = g->fstart[n]; k < end; k++) {
+            m = g->fnodes[k];
+            if (m == root && n != root)
+                break;
 
-    VISIT(n);
+            if (icomp[m] != comp)
+                continue;
 
-    /* Visit all nodes that point to this one */
-    for (l = n->fhead; l != NULL; l = l->fnext) {
-        f = l->from;
+            icomp[m] = -3 - n;
+            queue[tail++] = m;
+        }
 
-        if (V_DEBUG(V_DBG_INTERN))
-            fprintf(stderr, "      Looking at %s -> %s", f->name, n->name);
+        if (k < end)
+            break;
+    }
 
-        if (!VISITED(f)) {
-            /* Unvisited -- record path to it */
-            SETPATH(n, l);
-            vg_tsort_visit(g, f, order);
-        } else if (HASPATH(f)) {
-            /* Visited before -- check for cycle */
-            start = f;
-            first = n;
-            newcycle = 1;
-
-            while (HASPATH(f)) {
-                if (SEEN(f))
-                    newcycle = 0;
-                f = f->path->from;
-                if (f == first)
-                    break;
-            }
+    /* Follow links forwards back to the root */
+    cycle = vl_create();
+    while (n != root) {
+        vl_spush(cycle, g->nodevec[n]->name);
+        n = -3 - icomp[n];
+    }
 
-            /* If it's a new cycle, add it to the cycle list */
-            if (f == first && newcycle) {
-                LOOKAT(f);
-                cycle = vg_build_path(g, start);
-                vl_ppush(tsort_cycles, cycle);
-                if (V_DEBUG(V_DBG_INTERN))
-                    fprintf(stderr, "\nCycle found: %s\n",
-                            vl_join(cycle, " -> "));
-            }
-        }
+    vl_spush(cycle, g->nodevec[root]->name);
+
+    /* Restore component numbers */
+    while (tail > 0)
+        icomp[queue[--tail]] = comp;
+
+    return cycle;
+}
+
+/* Free the compiled form of a graph */
+static void
+vg_uncompile(vgraph *g)
+{
+    vg_pcache_free(g);
+
+    V_DEALLOC(g->rdist);
+    V_DEALLOC(g->rlink);
+    g->rcache = NULL;
+
+    V_DEALLOC(g->lmdist);
+
+    if (g->search != NULL) {
+        vg_search_end(g->search);
+        g->search = NULL;
     }
 
-    /* Add current node to sorted list */
-    vl_spush(order, n->name);
+    V_DEALLOC(g->icomp);
+    V_DEALLOC(g->ilink);
+    V_DEALLOC(g->ireach);
+    g->icount = -1;
+
+    V_DEALLOC(g->nodevec);
+    V_DEALLOC(g->linkvec);
+    V_DEALLOC(g->tstart);
+    V_DEALLOC(g->tlinks);
+    V_DEALLOC(g->tnodes);
+    V_DEALLOC(g->fstart);
+    V_DEALLOC(g->flinks);
+    V_DEALLOC(g->fnodes);
+    g->compiled = 0;
 }
 
 /*!
@@ -1798,6 +3867,63 @@ vg_use_cache(vgraph *g, int flag)
     g->use_cache = flag;
 }
 
+/*!
+  @brief   Set the indexed use-link function of a graph.
+  @ingroup graph_index
+  @param   g Graph.
+  @param   func Function to test link usage.
+
+  Like vg_use_link_function(), but the function is called with the
+  compiled index of the link instead of its node names and value.  If
+  set, it overrides any use-link function.
+*/
+void
+vg_use_ilink_function(vgraph *g, int (*func)(int link))
+{
+    VG_CHECK(g);
+    g->use_ilink = func;
+}
+
+/*!
+  @brief   Set the indexed use-node function of a graph.
+  @ingroup graph_index
+  @param   g Graph.
+  @param   func Function to test node usage.
+
+  Like vg_use_node_function(), but the function is called with the
+  compiled index of the node instead of its name and value.  If set, it
+  overrides any use-node function.
+*/
+void
+vg_use_inode_function(vgraph *g, int (*func)(int node, double dist))
+{
+    VG_CHECK(g);
+    g->use_inode = func;
+}
+
+/*!
+  @brief   Set the no. of landmarks used to direct path searches.
+  @ingroup graph_connect
+  @param   g Graph.
+  @param   num Max. no. of landmark nodes.
+
+  If nonzero (the default is zero), uncached searches for a path between
+  two nodes are directed towards the end node, instead of spreading out
+  evenly from the start node.  Path lengths from and to each landmark
+  node are found the first time they're needed, ignoring the connection
+  functions, and give lower bounds on the distance left to go.  The path
+  found is the same one an undirected search would find, provided the
+  use-node function doesn't depend on distance: if there are several
+  shortest paths, the undirected search is done instead.
+*/
+void
+vg_use_landmarks(vgraph *g, int num)
+{
+    VG_CHECK(g);
+    V_DEALLOC(g->lmdist);
+    g->landmarks = V_MAX(num, 0);
+}
+
 /*!
   @brief   Set the use-link function of a graph.
   @ingroup graph_connect
@@ -1842,16 +3968,20 @@ vg_use_node_function(vgraph *g, int (*func)(char *node,
 static vnode *
 vg_visit(vgraph *g, vnode *from, vnode *to, int type, vlist *visit)
 {
-    static vqueue *queue = NULL;
     vlink *l, *lnext;
+    vqueue *queue;
+    int k, end;
     double dist;
     vnode *n;
 
     /* Initialise */
-    vq_init(queue);
+    queue = vg_search_context(g)->queue;
+    vq_empty(queue);
 
     /* Set up initial links in queue */
-    for (l = from->thead; l != NULL; l = l->tnext) {
+    end = g->tstart[from->index + 1];
+    for (k = g->tstart[from->index]; k < end; k++) {
+        l = g->linkvec[g->tlinks[k]];
         if (USELINK(g, l)) {
             /* Get distance */
             switch (type) {
@@ -1869,6 +3999,7 @@ vg_visit(vgraph *g, vnode *from, vnode *to, int type, vlist *visit)
             /* Add link */
             SETDIST(l, dist);
             vq_pstore(queue, l, -dist);
+            g->relaxed++;
 
             /* Flag destination node as looked-at */
             LOOKAT(l->to);
@@ -1927,6 +4058,7 @@ vg_visit(vgraph *g, vnode *from, vnode *to, int type, vlist *visit)
 
         /* Flag node as visited */
         VISIT(n);
+        g->expanded++;
         if (visit != NULL)
             vl_spush(visit, n->name);
 
@@ -1935,7 +4067,10 @@ vg_visit(vgraph *g, vnode *from, vnode *to, int type, vlist *visit)
             break;
 
         /* Add node links to list */
-        for (lnext = l->to->thead; lnext != NULL; lnext = lnext->tnext) {
+        end = g->tstart[n->index + 1];
+        for (k = g->tstart[n->index]; k < end; k++) {
+            lnext = g->linkvec[g->tlinks[k]];
+
             /* Skip if destination node visited */
             if (VISITED(lnext->to))
                 continue;
@@ -1960,6 +4095,7 @@ vg_visit(vgraph *g, vnode *from, vnode *to, int type, vlist *visit)
             /* Add link */
             SETDIST(lnext, l->dist + dist);
             vq_pstore(queue, lnext, -lnext->dist);
+            g->relaxed++;
 
             /* Flag destination node as looked-at if required */
             if (!SEEN(lnext->to)) {
@@ -1973,13 +4109,37 @@ vg_visit(vgraph *g, vnode *from, vnode *to, int type, vlist *visit)
         }
     }
 
-    /* If destination not found, fail */
-    if (to != NULL && n != to)
+    /* If destination not found (or not usable), fail */
+    if (to != NULL && (n != to || !VISITED(to)))
         return NULL;
 
     return n;
 }
 
+/*!
+  @brief   Return path search work counts.
+  @ingroup graph_connect
+  @param   g Graph.
+  @param[out] nodes No. of nodes expanded by path searches.
+  @param[out] links No. of links queued by path searches.
+
+  All searches are counted, including those which build or repair path
+  caches.  Searches done in other contexts are counted when the context
+  is finished with.
+*/
+void
+vg_visit_info(vgraph *g, long *nodes, long *links)
+{
+    VG_CHECK(g);
+    *nodes = g->expanded;
+    *links = g->relaxed;
+
+    if (g->search != NULL) {
+        *nodes += g->search->expanded;
+        *links += g->search->relaxed;
+    }
+}
+
 /* Write graph to a stream */
 int
 vg_write(vgraph *g, FILE *fp)
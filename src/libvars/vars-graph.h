@@ -122,15 +122,28 @@
 #define vg_link_oneway_pstore(g, n1, n2, v) \
         vg_link_oneway_store(g, n1, n2, vs_pcreate(v))
 
+/*! @brief Get the pointer value of a node index. */
+#define vg_node_pvalue(g, n)     vs_pget(vg_node_value(g, n))
+
+/*! @brief Get the pointer value of a link index. */
+#define vg_link_pvalue(g, l)     vs_pget(vg_link_value(g, l))
+
 /*! @brief Graph type. */
 typedef struct v_graph vgraph;
 
+/*! @brief Graph search context type. */
+typedef struct v_search vsearch;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+extern void vg_cache_flush(vgraph *g);
+extern void vg_cache_info(vgraph *g, int *hits, int *misses);
+extern void vg_cache_size(vgraph *g, int size);
 extern int vg_caching(void);
 extern int vg_check(void *ptr);
+extern void vg_compile(vgraph *g);
 extern vlist *vg_connected(vgraph *g);
 extern vgraph *vg_copy(vgraph *g);
 extern vgraph *vg_create(void);
@@ -138,31 +151,55 @@ extern vtype *vg_declare(void);
 extern void vg_delete(vgraph *g, char *node);
 extern void vg_destroy(vgraph *g);
 extern int vg_freeze(vgraph *g, FILE *fp);
+extern double vg_ipath_cache(vgraph *g, int node);
+extern vlist *vg_ipath_info(vgraph *g, int node1, int node2);
+extern double vg_ipath_length(vgraph *g, int node1, int node2);
+extern vlist *vg_ipath_nodes(vgraph *g, int node1, int node2);
+extern double vg_ipath_rcache(vgraph *g, int node);
+extern int vg_ipath_reachable(vgraph *g, int node1, int node2);
+extern double vg_ipath_repair(vgraph *g);
+extern void vg_link_changed(vgraph *g, int link);
 extern int vg_link_count(vgraph *g);
 extern int vg_link_exists(vgraph *g, char *node1, char *node2);
+extern int vg_link_from(vgraph *g, int link);
 extern vscalar *vg_link_get(vgraph *g, char *node1, char *node2);
+extern int vg_link_index(vgraph *g, int node1, int node2);
 extern void vg_link_oneway_store(vgraph *g, char *node1, char *node2,
                                  vscalar *s);
 extern void vg_link_size_function(vgraph *g, double (*func)(char *node1,
                                   char *node2, vscalar *s));
 extern void vg_link_store(vgraph *g, char *node1, char *node2, vscalar *s);
+extern int vg_link_to(vgraph *g, int link);
+extern vscalar *vg_link_value(vgraph *g, int link);
+extern void vg_node_changed(vgraph *g, int node);
 extern int vg_node_count(vgraph *g);
 extern int vg_node_exists(vgraph *g, char *node);
 extern vlist *vg_node_from(vgraph *g, char *node);
 extern vscalar *vg_node_get(vgraph *g, char *node);
+extern int vg_node_in(vgraph *g, int node, int **links);
+extern int vg_node_index(vgraph *g, char *node);
 extern int vg_node_links(vgraph *g, char *node, int *from, int *to);
 extern vlist *vg_node_list(vgraph *g);
+extern char *vg_node_name(vgraph *g, int node);
+extern int vg_node_out(vgraph *g, int node, int **links);
 extern void vg_node_store(vgraph *g, char *node, vscalar *s);
 extern vlist *vg_node_to(vgraph *g, char *node);
+extern vscalar *vg_node_value(vgraph *g, int node);
 extern double vg_path_cache(vgraph *g, char *node);
 extern int vg_path_exists(vgraph *g, char *node1, char *node2);
 extern vlist *vg_path_info(vgraph *g, char *node1, char *node2);
 extern double vg_path_length(vgraph *g, char *node1, char *node2);
 extern vlist *vg_path_links(vgraph *g, char *from, char *to);
 extern vlist *vg_path_nodes(vgraph *g, char *node1, char *node2);
+extern double vg_path_rcache(vgraph *g, char *node);
 extern vlist *vg_path_reachable(vgraph *g, char *node);
 extern void vg_print(vgraph *g, FILE *fp);
 extern vgraph *vg_read(FILE *fp);
+extern vsearch *vg_search_begin(vgraph *g);
+extern void vg_search_end(vsearch *s);
+extern vlist *vg_search_info(vsearch *s, int node1, int node2);
+extern double vg_search_length(vsearch *s, int node1, int node2);
+extern vlist *vg_search_nodes(vsearch *s, int node1, int node2);
 extern vgraph *vg_thaw(FILE *fp);
 extern int vg_traverse(vgraph *g, int (*func)(void *ptr));
 extern vlist *vg_tsort(vgraph *g);
@@ -170,10 +207,15 @@ extern vlist *vg_tsort_cycles(void);
 extern void vg_unlink(vgraph *g, char *node1, char *node2);
 extern void vg_unlink_oneway(vgraph *g, char *node1, char *node2);
 extern void vg_use_cache(vgraph *g, int flag);
+extern void vg_use_ilink_function(vgraph *g, int (*func)(int link));
+extern void vg_use_inode_function(vgraph *g, int (*func)(int node,
+                                  double dist));
+extern void vg_use_landmarks(vgraph *g, int num);
 extern void vg_use_link_function(vgraph *g, int (*func)(char *node1,
                                  char *node2, vscalar *s));
 extern void vg_use_node_function(vgraph *g, int (*func)(char *node,
                                  vscalar *s, double dist));
+extern void vg_visit_info(vgraph *g, long *nodes, long *links);
 extern int vg_write(vgraph *g, FILE *fp);
 
 #ifdef __cplusplus
@@ -112,7 +112,9 @@ v_malloc(size_t size)
 {
     void *ptr;
 
-    v_memory_allocated = 1;
+    /* Only set once, so later allocations don't write to it */
+    if (!v_memory_allocated)
+        v_memory_allocated = 1;
 
     if (size == 0) {
         if (memerr_func == NULL)